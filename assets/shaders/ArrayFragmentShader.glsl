@@ -0,0 +1,15 @@
+#version 330 core
+
+// Variant of FragmentShader.glsl for assets whose textures are loaded as texture array layers
+uniform sampler2DArray ut_diffuse;
+uniform sampler2DArray ut_normal;
+
+in vec2 ov_uv_diffuse;
+in vec2 ov_uv_normal;
+flat in vec2 ov_layers;
+
+out vec4 of_color;
+
+void main() {
+    of_color = texture(ut_diffuse, vec3(ov_uv_diffuse, ov_layers.x)) + (texture(ut_normal, vec3(ov_uv_normal, ov_layers.y)) * 0.01);
+}
@@ -3,11 +3,12 @@
 uniform sampler2D ut_diffuse;
 uniform sampler2D ut_normal;
 
-in vec2 ov_uv;
+in vec2 ov_uv_diffuse;
+in vec2 ov_uv_normal;
 
 out vec4 of_color;
 
 void main() {
-    of_color = texture(ut_diffuse, ov_uv) + (texture(ut_normal, (ov_uv * vec2(1, -1))) * 0.01);
+    of_color = texture(ut_diffuse, ov_uv_diffuse) + (texture(ut_normal, ov_uv_normal) * 0.01);
 }
 
@@ -0,0 +1,16 @@
+#version 330 core
+
+uniform sampler2D ut_diffuse;
+
+in vec2 ov_uv;
+
+out vec4 of_color;
+
+void main() {
+    vec4 color = texture(ut_diffuse, ov_uv);
+    // Sprites are drawn in texture order rather than back to front, so cut out instead of blending
+    if (color.a < 0.5)
+        discard;
+
+    of_color = color;
+}
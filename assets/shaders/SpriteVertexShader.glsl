@@ -0,0 +1,20 @@
+#version 330 core
+
+// Shared by all programs, bound once per frame (see render_draw)
+layout(std140) uniform ub_camera {
+    mat4 um_view;
+    mat4 um_projection;
+    mat4 um_view_projection;
+    float uf_time;
+};
+
+// Already in world space, transformed by the sprite batcher
+layout(location = 0) in vec3 iv_position;
+layout(location = 1) in vec2 iv_uv;
+
+out vec2 ov_uv;
+
+void main() {
+    ov_uv = iv_uv;
+    gl_Position = um_view_projection * vec4(iv_position, 1.0);
+}
@@ -1,16 +1,31 @@
 #version 330 core
 
-uniform mat4 um_model;
-uniform mat4 um_view;
-uniform mat4 um_projection;
+// Shared by all programs, bound once per frame (see render_draw)
+layout(std140) uniform ub_camera {
+    mat4 um_view;
+    mat4 um_projection;
+    mat4 um_view_projection;
+    float uf_time;
+};
 
-in vec3 iv_position;
-in vec2 iv_uv;
+layout(location = 0) in vec3 iv_position;
+layout(location = 1) in vec2 iv_uv;
+// Per instance, occupies locations 4 to 7
+layout(location = 4) in mat4 iv_model;
+// Per instance, part of the bound textures the asset uses as (u, v, width, height)
+layout(location = 8) in vec4 iv_uv_diffuse;
+layout(location = 9) in vec4 iv_uv_normal;
+// Per instance, diffuse and normal layer for programs sampling texture arrays
+layout(location = 10) in vec2 iv_layers;
 
-out vec2 ov_uv;
+out vec2 ov_uv_diffuse;
+out vec2 ov_uv_normal;
+flat out vec2 ov_layers;
 
 void main() {
-    ov_uv = iv_uv;
-    gl_Position = um_projection * um_view * um_model * vec4(iv_position, 1.0);
+    ov_uv_diffuse = iv_uv_diffuse.xy + iv_uv * iv_uv_diffuse.zw;
+    // The normal map is sampled upside down
+    ov_uv_normal = iv_uv_normal.xy + vec2(iv_uv.x, 1.0 - iv_uv.y) * iv_uv_normal.zw;
+    ov_layers = iv_layers;
+    gl_Position = um_view_projection * iv_model * vec4(iv_position, 1.0);
 }
-
@@ -0,0 +1,184 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_ARCHETYPE_HPP
+#define FLATSHAPER_ARCHETYPE_HPP
+
+#include <flatshaper/entity.hpp>
+#include <flatshaper/component_store.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+typedef std::uint32_t componentid_t;
+
+namespace flatshaper {
+    constexpr std::size_t archetype_chunk_size = 16 * 1024;
+
+    // Components are moved between chunks with memcpy, so they must be plain data
+    componentid_t register_component_type(std::size_t size, std::size_t alignment);
+    std::size_t component_type_size(componentid_t componentid);
+
+    template<typename T>
+    componentid_t component_type_id() {
+        static_assert(std::is_trivially_copyable_v<T>, u8"Archetype components must be trivially copyable");
+        static componentid_t componentid = register_component_type(sizeof(T), alignof(T));
+        return componentid;
+    }
+
+    // A chunk stores the entity IDs and then one column per component type (structure of arrays),
+    // all laid out at fixed offsets in one 16 KiB block.
+    struct archetype_chunk {
+        alignas(64) std::uint8_t data[archetype_chunk_size];
+        std::uint32_t count = 0;
+    };
+
+    struct archetype {
+        // Sorted, so that the same component set always maps to the same archetype
+        std::vector<componentid_t> component_types;
+        std::vector<std::size_t> column_offsets;
+        std::vector<std::size_t> column_sizes;
+        std::uint32_t chunk_capacity = 0;
+        std::vector<std::unique_ptr<archetype_chunk>> chunks;
+
+        // Cached transitions to the archetype with one component added/removed
+        std::unordered_map<componentid_t, std::uint32_t> add_edges;
+        std::unordered_map<componentid_t, std::uint32_t> remove_edges;
+
+        // Column index of a component type, or -1 if this archetype doesn't have it
+        int column_of(componentid_t componentid) const {
+            auto it = std::lower_bound(component_types.begin(), component_types.end(), componentid);
+            if (it == component_types.end() || *it != componentid)
+                return -1;
+
+            return (int) (it - component_types.begin());
+        }
+    };
+
+    class archetype_world {
+    public:
+        archetype_world();
+
+        void create(entityid_t entityid);
+        void destroy(entityid_t entityid);
+        bool contains(entityid_t entityid) const;
+
+        template<typename T>
+        T &add_component(entityid_t entityid, const T &component) {
+            componentid_t componentid = component_type_id<T>();
+            T *existing = find_component<T>(entityid);
+            if (existing != nullptr) {
+                *existing = component;
+                return *existing;
+            }
+
+            void *column_entry = move_entity(entityid, componentid, true);
+            std::memcpy(column_entry, &component, sizeof(T));
+            return *((T *) column_entry);
+        }
+
+        template<typename T>
+        void remove_component(entityid_t entityid) {
+            if (find_component<T>(entityid) != nullptr)
+                move_entity(entityid, component_type_id<T>(), false);
+        }
+
+        template<typename T>
+        T *find_component(entityid_t entityid) {
+            const entity_location *location = locations.find(entityid);
+            if (location == nullptr)
+                return nullptr;
+
+            const archetype &entity_archetype = archetypes[location->archetype];
+            int column = entity_archetype.column_of(component_type_id<T>());
+            if (column < 0)
+                return nullptr;
+
+            std::uint8_t *data = entity_archetype.chunks[location->chunk]->data;
+            return ((T *) (data + entity_archetype.column_offsets[column])) + location->row;
+        }
+
+        // Calls function(count, entities, columns...) once for every non-empty chunk whose archetype
+        // has all of the requested components. Each column is a contiguous array of count elements.
+        template<typename... Components, typename Function>
+        void for_each_chunk(Function function) {
+            std::array<componentid_t, sizeof...(Components)> componentids{component_type_id<Components>()...};
+
+            for (archetype &candidate: archetypes) {
+                std::array<int, sizeof...(Components)> columns{};
+                bool matches = true;
+                for (std::size_t i = 0; i < componentids.size(); i++) {
+                    columns[i] = candidate.column_of(componentids[i]);
+                    matches = matches && columns[i] >= 0;
+                }
+
+                if (!matches)
+                    continue;
+
+                for (auto &chunk: candidate.chunks) {
+                    if (chunk->count == 0)
+                        continue;
+
+                    call_with_columns<Components...>(function, candidate, *chunk, columns,
+                                                     std::index_sequence_for<Components...>{});
+                }
+            }
+        }
+
+        std::size_t archetype_count() const {
+            return archetypes.size();
+        }
+
+    private:
+        struct entity_location {
+            std::uint32_t archetype;
+            std::uint32_t chunk;
+            std::uint32_t row;
+        };
+
+        std::vector<archetype> archetypes;
+        std::map<std::vector<componentid_t>, std::uint32_t> archetypes_by_component_types;
+        component_store<entity_location> locations;
+
+        std::uint32_t find_or_create_archetype(const std::vector<componentid_t> &component_types);
+        std::uint32_t archetype_edge(std::uint32_t source, componentid_t componentid, bool add);
+        entity_location allocate_row(std::uint32_t archetype_index, entityid_t entityid);
+        void release_row(const entity_location &location);
+        void *move_entity(entityid_t entityid, componentid_t componentid, bool add);
+
+        template<typename... Components, typename Function, std::size_t... Indices>
+        static void call_with_columns(Function &function,
+                                      archetype &chunk_archetype,
+                                      archetype_chunk &chunk,
+                                      const std::array<int, sizeof...(Components)> &columns,
+                                      std::index_sequence<Indices...>) {
+            function((std::size_t) chunk.count,
+                     (const entityid_t *) chunk.data,
+                     ((Components *) (chunk.data + chunk_archetype.column_offsets[columns[Indices]]))...);
+        }
+    };
+}
+
+#endif
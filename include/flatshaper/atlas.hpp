@@ -0,0 +1,65 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_ATLAS_HPP
+#define FLATSHAPER_ATLAS_HPP
+
+#include <cstdint>
+#include <vector>
+
+
+namespace flatshaper {
+    // Bottom-left skyline packer for one atlas page. The skyline is the upper outline of the
+    // rectangles placed so far; a new rectangle goes where it ends up lowest (then leftmost).
+    class skyline_packer {
+    public:
+        skyline_packer(std::uint32_t width, std::uint32_t height);
+
+        bool insert(std::uint32_t width, std::uint32_t height, std::uint32_t &x, std::uint32_t &y);
+
+    private:
+        struct segment {
+            std::uint32_t x;
+            std::uint32_t y;
+            std::uint32_t width;
+        };
+
+        // Lowest y at which a rectangle of the given width fits when starting at segment index
+        bool fits(std::size_t index, std::uint32_t width, std::uint32_t height, std::uint32_t &y) const;
+
+        std::uint32_t page_width;
+        std::uint32_t page_height;
+        std::vector<segment> skyline;
+    };
+
+    struct atlas_rect {
+        // Input
+        std::uint32_t width;
+        std::uint32_t height;
+        // Output
+        std::uint32_t page;
+        std::uint32_t x;
+        std::uint32_t y;
+    };
+
+    // Packs all rectangles, opening new pages as needed, and returns the number of pages.
+    // Every rectangle is padded by padding pixels on each side so that filtering does not bleed.
+    std::uint32_t atlas_pack(std::vector<atlas_rect> &rects, std::uint32_t page_width, std::uint32_t page_height,
+                             std::uint32_t padding);
+}
+
+#endif
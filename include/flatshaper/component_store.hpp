@@ -0,0 +1,258 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_COMPONENT_STORE_HPP
+#define FLATSHAPER_COMPONENT_STORE_HPP
+
+#include <flatshaper/entity.hpp>
+
+#include <vector>
+
+
+namespace flatshaper {
+    // Returns a new, globally unique structure version, see component_store::version()
+    std::uint64_t next_component_store_version();
+
+    constexpr std::uint32_t component_npos = UINT32_MAX;
+
+    // Change ticks: every write through a component store stamps the component with the current tick.
+    // A system remembers the tick it last closed and asks for everything changed after it.
+    std::uint32_t current_change_tick();
+    // Closes the current tick and returns it; writes from now on are stamped with the next one
+    std::uint32_t advance_change_tick();
+
+    // Wrap-around safe "tick is later than since"
+    constexpr bool tick_is_newer(std::uint32_t tick, std::uint32_t since) {
+        return (std::int32_t) (tick - since) > 0;
+    }
+
+    // Sparse set of components: the sparse array maps an entity index to a position in the
+    // densely packed entity/component arrays, so lookups are two array reads and iteration
+    // walks contiguous memory. Removal swaps the last element into the hole.
+    // insert() and operator[] stamp the component's change tick; writes through find() or
+    // component_at() have to be followed by mark_changed() to be visible to change queries.
+    template<typename T>
+    class component_store {
+    public:
+        static constexpr std::uint32_t npos = component_npos;
+
+        bool contains(entityid_t entityid) const {
+            return dense_index(entityid) != absent;
+        }
+
+        // Position of the entity in the dense arrays, or npos
+        std::uint32_t index_of(entityid_t entityid) const {
+            return dense_index(entityid);
+        }
+
+        // The entity holding the given entity index, or null_entity. Unlike contains(), this also
+        // finds a stale handle whose slot has been recycled since (see append())
+        entityid_t entity_with_index(std::uint32_t index) const {
+            if (index >= sparse.size() || sparse[index] == absent)
+                return null_entity;
+
+            return dense_entities[sparse[index]];
+        }
+
+        T *find(entityid_t entityid) {
+            std::uint32_t index = dense_index(entityid);
+            return index == absent ? nullptr : &dense_components[index];
+        }
+
+        const T *find(entityid_t entityid) const {
+            std::uint32_t index = dense_index(entityid);
+            return index == absent ? nullptr : &dense_components[index];
+        }
+
+        T &insert(entityid_t entityid, const T &component) {
+            std::uint32_t index = dense_index(entityid);
+            if (index != absent) {
+                dense_components[index] = component;
+                change_ticks[index] = current_change_tick();
+                return dense_components[index];
+            }
+
+            return append(entityid, component);
+        }
+
+        T &operator[](entityid_t entityid) {
+            std::uint32_t index = dense_index(entityid);
+            if (index != absent) {
+                change_ticks[index] = current_change_tick();
+                return dense_components[index];
+            }
+
+            return append(entityid, T{});
+        }
+
+        bool erase(entityid_t entityid) {
+            std::uint32_t index = dense_index(entityid);
+            if (index == absent)
+                return false;
+
+            auto last = (std::uint32_t) (dense_entities.size() - 1);
+            if (index != last) {
+                dense_entities[index] = dense_entities[last];
+                dense_components[index] = std::move(dense_components[last]);
+                change_ticks[index] = change_ticks[last];
+                sparse[entity_index(dense_entities[index])] = index;
+            }
+
+            sparse[entity_index(entityid)] = absent;
+            dense_entities.pop_back();
+            dense_components.pop_back();
+            change_ticks.pop_back();
+            structure_version = next_component_store_version();
+
+            return true;
+        }
+
+        void clear() {
+            for (entityid_t entityid: dense_entities) {
+                sparse[entity_index(entityid)] = absent;
+            }
+
+            dense_entities.clear();
+            dense_components.clear();
+            change_ticks.clear();
+            structure_version = next_component_store_version();
+        }
+
+        void reserve(std::size_t count) {
+            dense_entities.reserve(count);
+            dense_components.reserve(count);
+            change_ticks.reserve(count);
+        }
+
+        std::size_t size() const {
+            return dense_entities.size();
+        }
+
+        bool empty() const {
+            return dense_entities.empty();
+        }
+
+        entityid_t entity_at(std::size_t index) const {
+            return dense_entities[index];
+        }
+
+        T &component_at(std::size_t index) {
+            return dense_components[index];
+        }
+
+        const T &component_at(std::size_t index) const {
+            return dense_components[index];
+        }
+
+        const std::vector<entityid_t> &entities() const {
+            return dense_entities;
+        }
+
+        const std::vector<T> &components() const {
+            return dense_components;
+        }
+
+        void mark_changed(entityid_t entityid) {
+            std::uint32_t index = dense_index(entityid);
+            if (index != absent)
+                change_ticks[index] = current_change_tick();
+        }
+
+        void mark_changed_at(std::size_t index) {
+            change_ticks[index] = current_change_tick();
+        }
+
+        std::uint32_t change_tick_at(std::size_t index) const {
+            return change_ticks[index];
+        }
+
+        // Calls function(entityid, component) for every component written after the given tick
+        template<typename Function>
+        void each_changed_since(std::uint32_t tick, Function function) {
+            for (std::size_t i = 0; i < dense_entities.size(); i++) {
+                if (tick_is_newer(change_ticks[i], tick))
+                    function(dense_entities[i], dense_components[i]);
+            }
+        }
+
+        // Brings a copy of source up to date, given the tick at which it was last brought up to date.
+        // While neither store changed structure the dense arrays line up, so only the components
+        // written after that tick are copied (with their change ticks); otherwise all of source is.
+        void copy_changed_since(const component_store &source, std::uint32_t tick) {
+            if (structure_version != source.structure_version) {
+                *this = source;
+                return;
+            }
+
+            for (std::size_t i = 0; i < source.dense_entities.size(); i++) {
+                if (tick_is_newer(source.change_ticks[i], tick)) {
+                    dense_components[i] = source.dense_components[i];
+                    change_ticks[i] = source.change_ticks[i];
+                }
+            }
+        }
+
+        // Changes whenever an entity is added or removed (but not when a component value changes),
+        // so cached dense indices stay valid for as long as the version stays the same
+        std::uint64_t version() const {
+            return structure_version;
+        }
+
+    private:
+        static constexpr std::uint32_t absent = npos;
+
+        // Entity index -> position in the dense arrays, or absent
+        std::vector<std::uint32_t> sparse;
+        std::vector<entityid_t> dense_entities;
+        std::vector<T> dense_components;
+        std::vector<std::uint32_t> change_ticks;
+        std::uint64_t structure_version = next_component_store_version();
+
+        std::uint32_t dense_index(entityid_t entityid) const {
+            std::uint32_t index = entity_index(entityid);
+            if (index >= sparse.size())
+                return absent;
+
+            std::uint32_t position = sparse[index];
+            // The sparse slot may belong to an older generation of the same entity index
+            if (position == absent || dense_entities[position] != entityid)
+                return absent;
+
+            return position;
+        }
+
+        T &append(entityid_t entityid, const T &component) {
+            std::uint32_t index = entity_index(entityid);
+            if (index >= sparse.size())
+                sparse.resize(((std::size_t) index) + 1, absent);
+
+            // A stale handle of a recycled slot may still occupy the sparse entry
+            if (sparse[index] != absent)
+                erase(dense_entities[sparse[index]]);
+
+            sparse[index] = (std::uint32_t) dense_entities.size();
+            dense_entities.push_back(entityid);
+            dense_components.push_back(component);
+            change_ticks.push_back(current_change_tick());
+            structure_version = next_component_store_version();
+
+            return dense_components.back();
+        }
+    };
+}
+
+#endif
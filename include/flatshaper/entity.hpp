@@ -19,12 +19,32 @@
 #define FLATSHAPER_ENTITY_HPP
 
 #include <cinttypes>
+#include <vector>
 
+// An entity ID is a handle: the lower 32 bits are the index of the entity's slot,
+// the upper 32 bits are the generation of that slot at the time the entity was created.
+// Slots are recycled after deletion, so a handle is only valid while its generation matches.
 typedef std::uint64_t entityid_t;
 
 namespace flatshaper {
+    constexpr entityid_t null_entity = 0;
+
+    constexpr std::uint32_t entity_index(entityid_t entityid) {
+        return (std::uint32_t) (entityid & 0xFFFFFFFFu);
+    }
+
+    constexpr std::uint32_t entity_generation(entityid_t entityid) {
+        return (std::uint32_t) (entityid >> 32);
+    }
+
+    constexpr entityid_t make_entity_id(std::uint32_t index, std::uint32_t generation) {
+        return (((entityid_t) generation) << 32) | index;
+    }
+
     entityid_t generate_entity_id();
+    void generate_entity_ids(std::vector<entityid_t> &entityids, std::size_t count);
     void delete_entity(entityid_t entityid);
+    void delete_entities(const std::vector<entityid_t> &entityids);
     bool is_entity_valid(entityid_t entityid);
 }
 
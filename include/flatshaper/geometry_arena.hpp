@@ -0,0 +1,67 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_GEOMETRY_ARENA_HPP
+#define FLATSHAPER_GEOMETRY_ARENA_HPP
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+
+namespace flatshaper {
+    // Where a model lives in the arena, drawn with glDraw*BaseVertex
+    struct model_range {
+        // 1-based, 0 is no model
+        std::uint32_t model;
+        GLint base_vertex;
+        // Offset into the element buffer, in elements
+        GLuint first_element;
+        GLsizei element_count;
+    };
+
+    // All static meshes suballocated from one vertex and one element buffer behind one vertex
+    // array, so switching models needs no rebinds. Vertices are five floats (x, y, z, u, v).
+    // The buffers grow by doubling, which copies them on the GPU and re-points the vertex array.
+    class geometry_arena {
+    public:
+        void initialize(std::size_t vertex_capacity, std::size_t element_capacity);
+
+        // vertices need not be aligned, e.g. when pointing into a mapped file (see ply_mesh)
+        model_range add(const void *vertices, std::size_t vertex_count, const std::vector<std::uint32_t> &element_data);
+
+        GLuint vertex_array() const { return vertex_array_name; }
+
+    private:
+        // Copies the used part of buffer into a new buffer of new_capacity bytes
+        static GLuint grow_buffer(GLuint buffer, GLsizeiptr used, GLsizeiptr new_capacity);
+        void bind_buffers() const;
+
+        GLuint vertex_array_name = 0;
+        GLuint vertex_buffer = 0;
+        GLuint element_buffer = 0;
+
+        std::size_t vertex_capacity = 0;
+        std::size_t element_capacity = 0;
+        std::size_t vertex_count = 0;
+        std::size_t element_count = 0;
+        std::uint32_t model_count = 0;
+    };
+}
+
+#endif
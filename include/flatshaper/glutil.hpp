@@ -19,14 +19,30 @@
 #define FLATSHAPER_GLUTIL_HPP
 
 #include <glad/glad.h>
+#include <glm/vec3.hpp>
 
 #include <vector>
 #include <filesystem>
 
 
 namespace flatshaper {
-    GLuint load_model(const std::filesystem::path &ply_file, int32_t &element_count);
+    // Axis-aligned bounding box in model space
+    struct model_bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // Where an image ended up in the GL_TEXTURE_2D_ARRAYs created by load_texture_arrays
+    struct texture_layer {
+        GLuint texture;
+        GLint layer;
+    };
+
+    // Over vertices of five floats each (x, y, z, u, v), which need not be aligned (see ply_mesh)
+    model_bounds compute_model_bounds(const void *vertices, std::size_t vertex_count);
     GLuint load_texture(const std::filesystem::path &texture_file);
+    // Loads the images as layers of as few texture arrays as possible, the result matches texture_files
+    std::vector<texture_layer> load_texture_arrays(const std::vector<std::filesystem::path> &texture_files);
     GLuint load_shader(const std::filesystem::path &shader_file, GLenum shader_type);
 }
 
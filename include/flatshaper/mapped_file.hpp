@@ -0,0 +1,55 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_MAPPED_FILE_HPP
+#define FLATSHAPER_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+
+namespace flatshaper {
+    // Read-only view of a whole file, memory-mapped where the platform allows it and read into
+    // memory otherwise. The data stays valid as long as the object lives.
+    class mapped_file {
+    public:
+        mapped_file() = default;
+        explicit mapped_file(const std::filesystem::path &file);
+        ~mapped_file();
+
+        mapped_file(const mapped_file &) = delete;
+        mapped_file &operator=(const mapped_file &) = delete;
+        mapped_file(mapped_file &&other) noexcept;
+        mapped_file &operator=(mapped_file &&other) noexcept;
+
+        const char *data() const { return bytes; }
+
+        std::size_t size() const { return length; }
+
+    private:
+        void close();
+
+        const char *bytes = nullptr;
+        std::size_t length = 0;
+        bool mapped = false;
+        // Holds the file if it could not be mapped
+        std::vector<char> contents;
+    };
+}
+
+#endif
@@ -18,13 +18,30 @@
 #ifndef FLATSHAPER_PLYUTIL_HPP
 #define FLATSHAPER_PLYUTIL_HPP
 
+#include <flatshaper/mapped_file.hpp>
+
+#include <cstdint>
 #include <filesystem>
 #include <vector>
 
 namespace flatshaper {
-    void parse_ply(const std::filesystem::path &ply_file,
-                   std::vector<float> &vertex_data,
-                   std::vector<uint32_t> &element_data);
+    // A parsed PLY file with vertices of five floats each (x, y, z, u, v). If the file stores
+    // exactly that layout, vertices points into the mapped file and vertex_data stays empty.
+    // Any property type is accepted, positions are required and texture coordinates default to 0.
+    struct ply_mesh {
+        mapped_file file;
+        // Not necessarily float-aligned, read it with memcpy or hand it to GL
+        const void *vertices = nullptr;
+        std::size_t vertex_count = 0;
+        std::vector<float> vertex_data;
+        std::vector<uint32_t> element_data;
+        // Empty unless the file has them: nx, ny, nz and red, green, blue, alpha per vertex.
+        // Integer colors are scaled to 0 to 1, alpha defaults to 1.
+        std::vector<float> normal_data;
+        std::vector<float> color_data;
+    };
+
+    void parse_ply(const std::filesystem::path &ply_file, ply_mesh &mesh);
 }
 
 #endif
@@ -0,0 +1,74 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_RADIX_SORT_HPP
+#define FLATSHAPER_RADIX_SORT_HPP
+
+#include <array>
+#include <cinttypes>
+#include <vector>
+
+
+namespace flatshaper {
+    // Stable LSD radix sort on a 64-bit key, one byte per pass. The histograms of all passes are
+    // built in a single sweep, and passes in which every key has the same byte are skipped.
+    // scratch is resized to match items, keep it around between calls to avoid allocations.
+    template<typename T, typename KeyFunction>
+    void radix_sort(std::vector<T> &items, std::vector<T> &scratch, KeyFunction key) {
+        constexpr std::size_t passes = 8;
+        std::array<std::array<std::size_t, 256>, passes> histograms{};
+
+        for (const T &item: items) {
+            std::uint64_t item_key = key(item);
+            for (std::size_t pass = 0; pass < passes; pass++) {
+                histograms[pass][(item_key >> (pass * 8)) & 0xFFu]++;
+            }
+        }
+
+        scratch.resize(items.size());
+
+        for (std::size_t pass = 0; pass < passes; pass++) {
+            std::array<std::size_t, 256> &histogram = histograms[pass];
+
+            bool single_bucket = false;
+            for (std::size_t count: histogram) {
+                if (count == items.size()) {
+                    single_bucket = true;
+                    break;
+                }
+            }
+
+            if (single_bucket)
+                continue;
+
+            std::size_t offset = 0;
+            for (std::size_t &count: histogram) {
+                std::size_t bucket_size = count;
+                count = offset;
+                offset += bucket_size;
+            }
+
+            for (const T &item: items) {
+                scratch[histogram[(key(item) >> (pass * 8)) & 0xFFu]++] = item;
+            }
+
+            items.swap(scratch);
+        }
+    }
+}
+
+#endif
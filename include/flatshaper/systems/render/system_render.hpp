@@ -20,25 +20,67 @@
 
 #include "flatshaper/entity.hpp"
 
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 
 #include <filesystem>
 
 
 typedef std::uint32_t assetid_t;
 
+// Threading: render_initialize and render_load_assets run on the thread that has the GL context,
+// before the render thread takes it over. From then on render_draw runs on the render thread, and
+// everything else here is called from the simulation thread, which hands its state over with
+// render_submit_frame.
 namespace flatshaper::systems::render {
+    // Counters of the last render_draw() call, render thread only
+    struct render_statistics {
+        std::uint32_t draw_calls;
+        std::uint32_t visible_instances;
+        std::uint32_t sprites;
+        std::uint32_t program_changes;
+        std::uint32_t vertex_array_changes;
+        std::uint32_t texture_changes;
+        // Binds and uniform uploads that were dropped because the value was already set
+        std::uint32_t skipped_state_changes;
+        // Times the CPU blocked on a fence because the GPU still read a stream buffer section
+        std::uint32_t fence_waits;
+    };
+
+    extern render_statistics render_stats;
+
+    // Read by render_submit_frame
     extern glm::vec3 render_camera_position;
     extern glm::vec3 render_camera_direction;
     extern float render_screen_width;
     extern float render_screen_height;
     extern float render_fov;
+    // Seconds since startup, handed to the shaders
+    extern float render_time;
 
     void render_initialize(const std::filesystem::path& assets_directory);
 
     void render_load_assets(const std::filesystem::path& assets_list_file);
-    void render_add_entity(entityid_t entity, assetid_t assetid);
+    // Static entities are indexed in a spatial grid for culling, moving them is more expensive.
+    // The asset must be loaded already: entities are batched by its model, program and textures.
+    void render_add_entity(entityid_t entity, assetid_t assetid, bool is_static = false);
+    // Layers are drawn in ascending order, before any other sorting criteria
+    void render_set_layer(assetid_t assetid, std::uint8_t layer);
     void render_remove_entity(entityid_t entityid);
+    // Tiles are squares in the xy plane, tile (x, y) spans x to x + 1 and y to y + 1 times the tile
+    // size. Only the asset's program and textures are used, 0 clears the tile. The map is baked
+    // into meshes per 32x32 tiles, which are only rebuilt when one of their tiles changes.
+    void render_set_tile(std::int32_t x, std::int32_t y, assetid_t assetid);
+    // Defaults to a tile size of 1 at depth 0 in layer 0. Rebuilds the whole map.
+    void render_configure_tilemap(float tile_size, float depth, std::uint8_t layer);
+    // Queues a quad for the current frame only, textured with the asset's diffuse map.
+    // uv_rect is the sampled part of the asset's image as (u, v, width, height).
+    void render_draw_sprite(assetid_t assetid, glm::vec3 position, glm::vec2 size, float rotation = 0.0f,
+                            glm::vec4 uv_rect = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+    // Publishes the camera, all world matrices and this tick's sprites as the render thread's next
+    // snapshot. Never blocks; if the render thread is slow, it skips to the latest snapshot.
+    void render_submit_frame();
     void render_draw();
 }
 
@@ -19,16 +19,23 @@
 #define FLATSHAPER_SYSTEMS_SYSTEM_PHYSICS_HPP
 
 #include <flatshaper/entity.hpp>
+#include <flatshaper/component_store.hpp>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
 
-#include <unordered_map>
-
 
 namespace flatshaper::systems {
-    extern std::unordered_map<entityid_t, glm::vec3> physics_position;
-    extern std::unordered_map<entityid_t, glm::mat4> physics_matrix;
+    // Write positions through insert()/operator[] (or call mark_changed()),
+    // physics_simulate() only rebuilds the matrices of positions that changed
+    extern component_store<glm::vec3> physics_position;
+    extern component_store<glm::mat4> physics_matrix;
+
+    // Attaches an entity to a parent: its physics_position becomes relative to the parent,
+    // and its physics_matrix follows the parent's world matrix
+    void physics_set_parent(entityid_t entityid, entityid_t parent);
+    void physics_clear_parent(entityid_t entityid);
+    entityid_t physics_get_parent(entityid_t entityid);
 
     void physics_simulate();
 }
@@ -0,0 +1,84 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_THREAD_POOL_HPP
+#define FLATSHAPER_THREAD_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace flatshaper {
+    // Fixed set of worker threads for fork/join style jobs: run() hands out job indices to the
+    // workers and the calling thread, and returns once all of them are done. Calls from several
+    // threads are serialized.
+    class thread_pool {
+    public:
+        explicit thread_pool(std::size_t worker_count);
+        ~thread_pool();
+
+        thread_pool(const thread_pool &) = delete;
+        thread_pool &operator=(const thread_pool &) = delete;
+
+        // Calls job(index) for every index in [0, job_count)
+        void run(std::size_t job_count, const std::function<void(std::size_t)> &job);
+
+        // Calls function(begin, end) for consecutive ranges of at most grain items covering [0, count)
+        template<typename Function>
+        void parallel_for(std::size_t count, std::size_t grain, Function function) {
+            std::size_t job_count = (count + grain - 1) / grain;
+            run(job_count, [count, grain, &function](std::size_t index) {
+                std::size_t begin = index * grain;
+                function(begin, std::min(count, begin + grain));
+            });
+        }
+
+        // Workers plus the calling thread
+        std::size_t thread_count() const {
+            return workers.size() + 1;
+        }
+
+    private:
+        void worker_loop();
+        void run_jobs();
+
+        std::vector<std::thread> workers;
+
+        std::mutex run_mutex;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+
+        const std::function<void(std::size_t)> *job = nullptr;
+        std::size_t job_count = 0;
+        std::atomic<std::size_t> next_job{0};
+        std::size_t busy_workers = 0;
+        std::uint64_t generation = 0;
+        bool stopping = false;
+    };
+
+    // Shared by all systems, one thread per hardware thread including the caller
+    thread_pool &worker_pool();
+}
+
+#endif
@@ -0,0 +1,69 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_TRIPLE_BUFFER_HPP
+#define FLATSHAPER_TRIPLE_BUFFER_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+
+namespace flatshaper {
+    // Lock-free hand-over of whole values from one producer thread to one consumer thread.
+    // The producer fills its back buffer and publishes it, the consumer picks up the latest
+    // published buffer; neither ever waits for the other. Buffers published while the consumer
+    // was busy are skipped, so T has to be a complete state, not a delta.
+    template<typename T>
+    class triple_buffer {
+    public:
+        // Producer side
+        T &write_buffer() {
+            return buffers[back];
+        }
+
+        // Producer side: hands the back buffer over and continues on the buffer that was shared
+        void publish() {
+            back = shared.exchange(back | fresh_bit, std::memory_order_acq_rel) & index_mask;
+        }
+
+        // Consumer side: switches to the latest published buffer, false if nothing new was published
+        bool acquire() {
+            if ((shared.load(std::memory_order_relaxed) & fresh_bit) == 0)
+                return false;
+
+            front = shared.exchange(front, std::memory_order_acq_rel) & index_mask;
+            return true;
+        }
+
+        // Consumer side
+        T &read_buffer() {
+            return buffers[front];
+        }
+
+    private:
+        static constexpr std::uint8_t index_mask = 0x3u;
+        static constexpr std::uint8_t fresh_bit = 0x4u;
+
+        std::array<T, 3> buffers{};
+        std::uint8_t back = 0;
+        std::atomic<std::uint8_t> shared{1};
+        std::uint8_t front = 2;
+    };
+}
+
+#endif
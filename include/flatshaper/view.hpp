@@ -0,0 +1,112 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#ifndef FLATSHAPER_VIEW_HPP
+#define FLATSHAPER_VIEW_HPP
+
+#include <flatshaper/component_store.hpp>
+
+#include <array>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+namespace flatshaper {
+    // Join over several component stores: yields every entity that has all of the components.
+    // The store types are fixed at compile time, so probing is inlined without any dispatch.
+    // The matching dense indices are cached and only rebuilt when one of the stores gains or
+    // loses entities, so iterating an unchanged world is a walk over a flat index list.
+    template<typename... Components>
+    class view {
+    public:
+        explicit view(component_store<Components> &...stores) : stores(&stores...) {}
+
+        // Calls function(entityid, components...) for every matching entity
+        template<typename Function>
+        void each(Function function) {
+            refresh();
+
+            for (const match &entry: matches) {
+                call(function, entry, std::index_sequence_for<Components...>{});
+            }
+        }
+
+        std::size_t size() {
+            refresh();
+            return matches.size();
+        }
+
+    private:
+        static constexpr std::size_t component_count = sizeof...(Components);
+
+        struct match {
+            entityid_t entityid;
+            std::array<std::uint32_t, component_count> indices;
+        };
+
+        std::tuple<component_store<Components> *...> stores;
+        std::array<std::uint64_t, component_count> cached_versions{};
+        std::vector<match> matches;
+
+        void refresh() {
+            std::array<std::uint64_t, component_count> versions = current_versions(std::index_sequence_for<Components...>{});
+            if (versions == cached_versions)
+                return;
+
+            rebuild(std::index_sequence_for<Components...>{});
+            cached_versions = versions;
+        }
+
+        template<std::size_t... Indices>
+        std::array<std::uint64_t, component_count> current_versions(std::index_sequence<Indices...>) const {
+            return {std::get<Indices>(stores)->version()...};
+        }
+
+        template<std::size_t... Indices>
+        void rebuild(std::index_sequence<Indices...>) {
+            matches.clear();
+
+            // Drive the join from the smallest store, probe all others
+            const std::vector<entityid_t> *candidates[] = {&std::get<Indices>(stores)->entities()...};
+            const std::vector<entityid_t> *smallest = candidates[0];
+            for (const std::vector<entityid_t> *candidate: candidates) {
+                if (candidate->size() < smallest->size())
+                    smallest = candidate;
+            }
+
+            for (entityid_t entityid: *smallest) {
+                match entry{entityid, {std::get<Indices>(stores)->index_of(entityid)...}};
+
+                bool complete = true;
+                for (std::uint32_t index: entry.indices) {
+                    complete = complete && index != component_npos;
+                }
+
+                if (complete)
+                    matches.push_back(entry);
+            }
+        }
+
+        template<typename Function, std::size_t... Indices>
+        void call(Function &function, const match &entry, std::index_sequence<Indices...>) {
+            function(entry.entityid, std::get<Indices>(stores)->component_at(entry.indices[Indices])...);
+        }
+    };
+}
+
+#endif
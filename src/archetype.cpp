@@ -0,0 +1,218 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <flatshaper/archetype.hpp>
+
+#include <stdexcept>
+
+namespace flatshaper {
+    struct component_type_info {
+        std::size_t size;
+        std::size_t alignment;
+    };
+
+    std::vector<component_type_info> &component_types() {
+        static std::vector<component_type_info> types;
+        return types;
+    }
+
+    componentid_t register_component_type(std::size_t size, std::size_t alignment) {
+        if (size == 0 || alignment > alignof(archetype_chunk))
+            throw std::runtime_error(u8"Unsupported archetype component type");
+
+        component_types().push_back(component_type_info{size, alignment});
+        return (componentid_t) (component_types().size() - 1);
+    }
+
+    std::size_t component_type_size(componentid_t componentid) {
+        return component_types()[componentid].size;
+    }
+
+    std::size_t align_up(std::size_t value, std::size_t alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Computes the column offsets for the given capacity, returns false if they don't fit into a chunk
+    bool layout_columns(archetype &layout, std::uint32_t capacity) {
+        std::size_t offset = capacity * sizeof(entityid_t);
+
+        for (std::size_t i = 0; i < layout.component_types.size(); i++) {
+            const component_type_info &info = component_types()[layout.component_types[i]];
+            offset = align_up(offset, info.alignment);
+            layout.column_offsets[i] = offset;
+            layout.column_sizes[i] = info.size;
+            offset += capacity * info.size;
+        }
+
+        return offset <= archetype_chunk_size;
+    }
+
+    archetype_world::archetype_world() {
+        // Archetype 0 holds entities without any components
+        find_or_create_archetype({});
+    }
+
+    void archetype_world::create(entityid_t entityid) {
+        if (locations.contains(entityid))
+            return;
+
+        locations.insert(entityid, allocate_row(0, entityid));
+    }
+
+    void archetype_world::destroy(entityid_t entityid) {
+        const entity_location *location = locations.find(entityid);
+        if (location == nullptr)
+            return;
+
+        release_row(*location);
+        locations.erase(entityid);
+    }
+
+    bool archetype_world::contains(entityid_t entityid) const {
+        return locations.contains(entityid);
+    }
+
+    std::uint32_t archetype_world::find_or_create_archetype(const std::vector<componentid_t> &component_types) {
+        auto existing = archetypes_by_component_types.find(component_types);
+        if (existing != archetypes_by_component_types.end())
+            return existing->second;
+
+        archetype created;
+        created.component_types = component_types;
+        created.column_offsets.resize(component_types.size());
+        created.column_sizes.resize(component_types.size());
+
+        std::size_t row_size = sizeof(entityid_t);
+        for (componentid_t componentid: component_types) {
+            row_size += component_type_size(componentid);
+        }
+
+        // Start from the unpadded estimate and shrink until alignment padding fits as well
+        auto capacity = (std::uint32_t) (archetype_chunk_size / row_size);
+        while (capacity > 0 && !layout_columns(created, capacity)) {
+            capacity--;
+        }
+
+        if (capacity == 0)
+            throw std::runtime_error(u8"Archetype components don't fit into a chunk");
+
+        created.chunk_capacity = capacity;
+
+        auto index = (std::uint32_t) archetypes.size();
+        archetypes.push_back(std::move(created));
+        archetypes_by_component_types[component_types] = index;
+
+        return index;
+    }
+
+    std::uint32_t archetype_world::archetype_edge(std::uint32_t source, componentid_t componentid, bool add) {
+        auto &edges = add ? archetypes[source].add_edges : archetypes[source].remove_edges;
+        auto edge = edges.find(componentid);
+        if (edge != edges.end())
+            return edge->second;
+
+        std::vector<componentid_t> component_types = archetypes[source].component_types;
+        if (add) {
+            component_types.insert(std::lower_bound(component_types.begin(), component_types.end(), componentid), componentid);
+        } else {
+            component_types.erase(std::lower_bound(component_types.begin(), component_types.end(), componentid));
+        }
+
+        // Creating the archetype may reallocate the archetype list, so look the edges up again afterwards
+        std::uint32_t target = find_or_create_archetype(component_types);
+        (add ? archetypes[source].add_edges : archetypes[source].remove_edges)[componentid] = target;
+
+        return target;
+    }
+
+    archetype_world::entity_location archetype_world::allocate_row(std::uint32_t archetype_index, entityid_t entityid) {
+        archetype &target = archetypes[archetype_index];
+
+        if (target.chunks.empty() || target.chunks.back()->count == target.chunk_capacity)
+            target.chunks.push_back(std::make_unique<archetype_chunk>());
+
+        archetype_chunk &chunk = *target.chunks.back();
+        std::uint32_t row = chunk.count++;
+        ((entityid_t *) chunk.data)[row] = entityid;
+
+        return entity_location{archetype_index, (std::uint32_t) (target.chunks.size() - 1), row};
+    }
+
+    void archetype_world::release_row(const entity_location &location) {
+        archetype &source = archetypes[location.archetype];
+        archetype_chunk &chunk = *source.chunks[location.chunk];
+        archetype_chunk &last_chunk = *source.chunks.back();
+        std::uint32_t last_row = last_chunk.count - 1;
+
+        // Keep chunks densely packed by moving the archetype's last row into the hole
+        if (&chunk != &last_chunk || location.row != last_row) {
+            entityid_t moved_entity = ((entityid_t *) last_chunk.data)[last_row];
+            ((entityid_t *) chunk.data)[location.row] = moved_entity;
+
+            for (std::size_t i = 0; i < source.component_types.size(); i++) {
+                std::size_t size = source.column_sizes[i];
+                std::uint8_t *column = chunk.data + source.column_offsets[i];
+                std::uint8_t *last_column = last_chunk.data + source.column_offsets[i];
+                std::memcpy(column + location.row * size, last_column + last_row * size, size);
+            }
+
+            *locations.find(moved_entity) = location;
+        }
+
+        last_chunk.count--;
+        if (last_chunk.count == 0)
+            source.chunks.pop_back();
+    }
+
+    void *archetype_world::move_entity(entityid_t entityid, componentid_t componentid, bool add) {
+        entity_location *location = locations.find(entityid);
+        if (location == nullptr) {
+            create(entityid);
+            location = locations.find(entityid);
+        }
+
+        entity_location source_location = *location;
+        std::uint32_t target_index = archetype_edge(source_location.archetype, componentid, add);
+        entity_location target_location = allocate_row(target_index, entityid);
+
+        archetype &source = archetypes[source_location.archetype];
+        archetype &target = archetypes[target_index];
+        archetype_chunk &source_chunk = *source.chunks[source_location.chunk];
+        archetype_chunk &target_chunk = *target.chunks[target_location.chunk];
+
+        // Copy every component both archetypes have in common
+        for (std::size_t i = 0; i < target.component_types.size(); i++) {
+            int source_column = source.column_of(target.component_types[i]);
+            if (source_column < 0)
+                continue;
+
+            std::size_t size = target.column_sizes[i];
+            std::memcpy(target_chunk.data + target.column_offsets[i] + target_location.row * size,
+                        source_chunk.data + source.column_offsets[source_column] + source_location.row * size,
+                        size);
+        }
+
+        release_row(source_location);
+        *locations.find(entityid) = target_location;
+
+        if (!add)
+            return nullptr;
+
+        int column = target.column_of(componentid);
+        return target_chunk.data + target.column_offsets[column] + target_location.row * target.column_sizes[column];
+    }
+}
@@ -0,0 +1,124 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <flatshaper/atlas.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+
+namespace flatshaper {
+    skyline_packer::skyline_packer(std::uint32_t width, std::uint32_t height)
+            : page_width(width), page_height(height), skyline{segment{0, 0, width}} {}
+
+    bool skyline_packer::fits(std::size_t index, std::uint32_t width, std::uint32_t height, std::uint32_t &y) const {
+        if (skyline[index].x + width > page_width)
+            return false;
+
+        y = 0;
+        std::uint32_t width_left = width;
+        for (std::size_t i = index; width_left > 0; i++) {
+            y = std::max(y, skyline[i].y);
+            if (y + height > page_height)
+                return false;
+
+            width_left -= std::min(width_left, skyline[i].width);
+        }
+
+        return true;
+    }
+
+    bool skyline_packer::insert(std::uint32_t width, std::uint32_t height, std::uint32_t &x, std::uint32_t &y) {
+        std::size_t best_index = skyline.size();
+        std::uint32_t best_y = UINT32_MAX;
+        for (std::size_t i = 0; i < skyline.size(); i++) {
+            std::uint32_t candidate_y;
+            if (fits(i, width, height, candidate_y) && candidate_y < best_y) {
+                best_index = i;
+                best_y = candidate_y;
+            }
+        }
+
+        if (best_index == skyline.size())
+            return false;
+
+        x = skyline[best_index].x;
+        y = best_y;
+
+        // The new rectangle's top replaces every segment it covers, partially covered ones are cut
+        std::uint32_t right = x + width;
+        std::size_t end = best_index;
+        while (end < skyline.size() && skyline[end].x + skyline[end].width <= right)
+            end++;
+
+        if (end < skyline.size() && skyline[end].x < right) {
+            skyline[end].width -= right - skyline[end].x;
+            skyline[end].x = right;
+        }
+
+        skyline.erase(skyline.begin() + (long) best_index, skyline.begin() + (long) end);
+        skyline.insert(skyline.begin() + (long) best_index, segment{x, y + height, width});
+
+        // Merge neighbours at the same height, so that the skyline stays short
+        for (std::size_t i = 0; i + 1 < skyline.size();) {
+            if (skyline[i].y == skyline[i + 1].y) {
+                skyline[i].width += skyline[i + 1].width;
+                skyline.erase(skyline.begin() + (long) i + 1);
+            } else {
+                i++;
+            }
+        }
+
+        return true;
+    }
+
+    std::uint32_t atlas_pack(std::vector<atlas_rect> &rects, std::uint32_t page_width, std::uint32_t page_height,
+                             std::uint32_t padding) {
+        // Placing tall rectangles first leaves a flatter skyline for the rest
+        std::vector<std::size_t> order(rects.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&rects](std::size_t a, std::size_t b) {
+            return rects[a].height > rects[b].height;
+        });
+
+        std::vector<skyline_packer> pages;
+        for (std::size_t index: order) {
+            atlas_rect &rect = rects[index];
+            std::uint32_t padded_width = rect.width + 2 * padding;
+            std::uint32_t padded_height = rect.height + 2 * padding;
+            if (padded_width > page_width || padded_height > page_height)
+                throw std::runtime_error(u8"Texture does not fit on an atlas page");
+
+            std::uint32_t x = 0, y = 0;
+            std::size_t page = 0;
+            while (page < pages.size() && !pages[page].insert(padded_width, padded_height, x, y))
+                page++;
+
+            if (page == pages.size()) {
+                pages.emplace_back(page_width, page_height);
+                pages.back().insert(padded_width, padded_height, x, y);
+            }
+
+            rect.page = (std::uint32_t) page;
+            rect.x = x + padding;
+            rect.y = y + padding;
+        }
+
+        return (std::uint32_t) pages.size();
+    }
+}
@@ -0,0 +1,148 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Compares iterating the same position -> matrix pass (what physics_simulate does for root
+// entities) over sparse-set component stores and over archetype chunks.
+// Usage: flatshaper_archetype_benchmark [entity count] [passes]
+
+#include <flatshaper/entity.hpp>
+#include <flatshaper/component_store.hpp>
+#include <flatshaper/archetype.hpp>
+#include <flatshaper/view.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+
+namespace {
+    // Plain stand-ins for glm::vec3/glm::mat4, so the benchmark needs nothing beyond the ECS
+    struct position {
+        float x, y, z;
+    };
+
+    struct matrix {
+        float m[16];
+    };
+
+    // A component only some entities have, so the world ends up with more than one archetype
+    struct velocity {
+        float x, y, z;
+    };
+
+    void write_translation(matrix &target, const position &source) {
+        for (int i = 0; i < 16; i++) {
+            target.m[i] = i % 5 == 0 ? 1.0f : 0.0f;
+        }
+
+        target.m[12] = source.x;
+        target.m[13] = source.y;
+        target.m[14] = source.z;
+    }
+
+    float checksum(const matrix &source) {
+        return source.m[12] + source.m[13] + source.m[14];
+    }
+
+    template<typename Function>
+    void run(const char *name, std::size_t passes, std::size_t entity_count, Function pass) {
+        float sum = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < passes; i++) {
+            sum += pass();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << name << ": " << seconds * 1e3 / (double) passes << " ms/pass, "
+                  << (double) (entity_count * passes) / seconds / 1e6 << " M entities/s"
+                  << " (checksum " << sum << ")" << std::endl;
+    }
+}
+
+int main(int argc, char **argv) {
+    std::size_t entity_count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    std::size_t passes = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 50;
+
+    std::vector<entityid_t> entityids;
+    flatshaper::generate_entity_ids(entityids, entity_count);
+
+    flatshaper::component_store<position> positions;
+    flatshaper::component_store<matrix> matrices;
+    flatshaper::component_store<velocity> velocities;
+    flatshaper::archetype_world world;
+
+    positions.reserve(entity_count);
+    matrices.reserve(entity_count);
+    for (std::size_t i = 0; i < entity_count; i++) {
+        entityid_t entityid = entityids[i];
+        position entity_position{(float) i, (float) (i % 7), 1.0f};
+
+        positions.insert(entityid, entity_position);
+        matrices.insert(entityid, matrix{});
+
+        world.create(entityid);
+        world.add_component(entityid, entity_position);
+        world.add_component(entityid, matrix{});
+
+        if (i % 2 == 0) {
+            velocities.insert(entityid, velocity{1.0f, 0.0f, 0.0f});
+            world.add_component(entityid, velocity{1.0f, 0.0f, 0.0f});
+        }
+    }
+
+    std::cout << entity_count << " entities, " << world.archetype_count() << " archetypes, "
+              << passes << " passes" << std::endl;
+
+    // Walks the positions densely and looks each matrix up through the sparse array
+    run("component_store lookup", passes, entity_count, [&]() {
+        float sum = 0.0f;
+        for (std::size_t i = 0; i < positions.size(); i++) {
+            matrix *target = matrices.find(positions.entity_at(i));
+            write_translation(*target, positions.component_at(i));
+            sum += checksum(*target);
+        }
+
+        return sum;
+    });
+
+    flatshaper::view<position, matrix> position_matrix_view(positions, matrices);
+    run("view<position, matrix>", passes, entity_count, [&]() {
+        float sum = 0.0f;
+        position_matrix_view.each([&](entityid_t, position &source, matrix &target) {
+            write_translation(target, source);
+            sum += checksum(target);
+        });
+
+        return sum;
+    });
+
+    run("archetype_world chunks", passes, entity_count, [&]() {
+        float sum = 0.0f;
+        world.for_each_chunk<position, matrix>([&](std::size_t count, const entityid_t *, position *sources, matrix *targets) {
+            for (std::size_t i = 0; i < count; i++) {
+                write_translation(targets[i], sources[i]);
+                sum += checksum(targets[i]);
+            }
+        });
+
+        return sum;
+    });
+
+    return 0;
+}
@@ -0,0 +1,173 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Writes an ASCII PLY grid mesh and times loading it with parse_ply against the operator>> loop
+// it replaced, checking that both produce the same data.
+// Usage: flatshaper_ply_benchmark [grid size] [runs]
+
+#include <flatshaper/plyutil.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+    // (grid_size + 1)^2 vertices with normals as extra properties, two triangles per grid cell
+    void write_ascii_grid(const std::filesystem::path &ply_file, std::uint32_t grid_size) {
+        std::uint32_t row_vertices = grid_size + 1;
+        std::ofstream output(ply_file);
+        output << "ply\nformat ascii 1.0\ncomment flatshaper_ply_benchmark\n"
+               << "element vertex " << row_vertices * row_vertices << "\n"
+               << "property float x\nproperty float y\nproperty float z\n"
+               << "property float nx\nproperty float ny\nproperty float nz\n"
+               << "property float s\nproperty float t\n"
+               << "element face " << grid_size * grid_size * 2 << "\n"
+               << "property list uchar uint vertex_indices\nend_header\n";
+
+        for (std::uint32_t y = 0; y < row_vertices; y++) {
+            for (std::uint32_t x = 0; x < row_vertices; x++) {
+                float s = (float) x / (float) grid_size;
+                float t = (float) y / (float) grid_size;
+                output << s * 10.0f - 5.0f << ' ' << t * 10.0f - 5.0f << ' ' << -0.125f << " 0 0 1 "
+                       << s << ' ' << t << '\n';
+            }
+        }
+
+        for (std::uint32_t y = 0; y < grid_size; y++) {
+            for (std::uint32_t x = 0; x < grid_size; x++) {
+                std::uint32_t first = y * row_vertices + x;
+                output << "3 " << first << ' ' << first + 1 << ' ' << first + row_vertices + 1 << '\n'
+                       << "3 " << first + row_vertices + 1 << ' ' << first + row_vertices << ' ' << first << '\n';
+            }
+        }
+
+        if (!output)
+            throw std::runtime_error(u8"Cannot write " + ply_file.string());
+    }
+
+    // The ASCII path as it was before the tokenizer: a line-by-line header scan, then operator>>
+    // for every value. Only handles what write_ascii_grid writes.
+    void parse_ascii_with_streams(const std::filesystem::path &ply_file,
+                                  std::vector<float> &vertex_data,
+                                  std::vector<std::uint32_t> &element_data) {
+        std::ifstream input(ply_file);
+        std::uint32_t vertex_count = 0;
+        std::uint32_t face_count = 0;
+        std::vector<std::string> properties;
+
+        std::string line;
+        while (std::getline(input, line) && line != u8"end_header") {
+            if (line.rfind(u8"element vertex ", 0) == 0)
+                vertex_count = (std::uint32_t) std::stoul(line.substr(15));
+            else if (line.rfind(u8"element face ", 0) == 0)
+                face_count = (std::uint32_t) std::stoul(line.substr(13));
+            else if (line.rfind(u8"property float ", 0) == 0)
+                properties.push_back(line.substr(15));
+        }
+
+        vertex_data.clear();
+        element_data.clear();
+        vertex_data.reserve(vertex_count * 5);
+        element_data.reserve(face_count * 3);
+
+        const char *layout[5] = {u8"x", u8"y", u8"z", u8"s", u8"t"};
+        std::string ignored;
+        for (std::uint32_t i = 0; i < vertex_count; i++) {
+            float values[5]{};
+            for (const std::string &property: properties) {
+                float *target = nullptr;
+                for (int j = 0; j < 5; j++) {
+                    if (property == layout[j])
+                        target = &values[j];
+                }
+
+                if (target != nullptr)
+                    input >> *target;
+                else
+                    input >> ignored;
+            }
+
+            vertex_data.insert(vertex_data.end(), values, values + 5);
+        }
+
+        for (std::uint32_t i = 0; i < face_count; i++) {
+            std::uint32_t face_vertex_count = 0, a = 0, b = 0, c = 0;
+            input >> face_vertex_count >> a >> b >> c;
+            if (face_vertex_count != 3)
+                throw std::runtime_error(u8"Malformed PLY file (face doesn't have exactly 3 vertices)");
+
+            element_data.insert(element_data.end(), {a, b, c});
+        }
+    }
+
+    template<typename Function>
+    double seconds_per_run(std::size_t runs, Function function) {
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < runs; i++) {
+            function();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        return std::chrono::duration<double>(end - start).count() / (double) runs;
+    }
+}
+
+int main(int argc, char **argv) {
+    auto grid_size = (std::uint32_t) (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 512);
+    std::size_t runs = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 5;
+
+    std::filesystem::path ply_file = std::filesystem::temp_directory_path() / u8"flatshaper_ply_benchmark.ply";
+    write_ascii_grid(ply_file, grid_size);
+    double megabytes = (double) std::filesystem::file_size(ply_file) / (1024.0 * 1024.0);
+
+    std::vector<float> stream_vertices;
+    std::vector<std::uint32_t> stream_elements;
+    double stream_seconds = seconds_per_run(runs, [&]() {
+        parse_ascii_with_streams(ply_file, stream_vertices, stream_elements);
+    });
+
+    flatshaper::ply_mesh mesh;
+    double tokenizer_seconds = seconds_per_run(runs, [&]() {
+        mesh = flatshaper::ply_mesh();
+        flatshaper::parse_ply(ply_file, mesh);
+    });
+
+    bool same = mesh.vertex_count * 5 == stream_vertices.size() &&
+                mesh.element_data == stream_elements &&
+                std::memcmp(mesh.vertices, stream_vertices.data(), stream_vertices.size() * sizeof(float)) == 0;
+
+    std::filesystem::remove(ply_file);
+
+    std::cout << megabytes << " MiB, " << mesh.vertex_count << " vertices, " << mesh.element_data.size() / 3
+              << " faces, " << runs << " runs" << std::endl;
+    std::cout << "operator>>: " << stream_seconds * 1e3 << " ms, " << megabytes / stream_seconds << " MiB/s" << std::endl;
+    std::cout << "parse_ply:  " << tokenizer_seconds * 1e3 << " ms, " << megabytes / tokenizer_seconds << " MiB/s" << std::endl;
+
+    if (!same) {
+        std::cerr << "The parsers disagree" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
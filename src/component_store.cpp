@@ -0,0 +1,39 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <flatshaper/component_store.hpp>
+
+#include <atomic>
+
+namespace flatshaper {
+    std::atomic<std::uint32_t> change_tick{1};
+
+    std::uint32_t current_change_tick() {
+        return change_tick.load(std::memory_order_relaxed);
+    }
+
+    std::uint32_t advance_change_tick() {
+        return change_tick.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::uint64_t next_component_store_version() {
+        // Versions are shared between all stores, so two stores only ever report
+        // the same version if one is a copy of the other
+        static std::atomic<std::uint64_t> version{1};
+        return version.fetch_add(1, std::memory_order_relaxed);
+    }
+}
@@ -17,24 +17,77 @@
 
 #include <flatshaper/entity.hpp>
 
-#include <unordered_set>
+#include <algorithm>
+#include <stdexcept>
 
 namespace flatshaper {
-    entityid_t next_id = 1;
-    std::unordered_set<entityid_t> deleted_ids;
+    // Current generation of every slot ever handed out, indexed by entity index.
+    // Generations start at 1, so the null entity (0) is never valid.
+    std::vector<std::uint32_t> entity_generations;
+    // Indices of deleted slots, reused before new slots are appended
+    std::vector<std::uint32_t> free_entity_indices;
 
     entityid_t generate_entity_id() {
-        entityid_t id = next_id;
-        next_id++;
+        if (!free_entity_indices.empty()) {
+            std::uint32_t index = free_entity_indices.back();
+            free_entity_indices.pop_back();
 
-        return id;
+            return make_entity_id(index, entity_generations[index]);
+        }
+
+        if (entity_generations.size() > UINT32_MAX)
+            throw std::runtime_error(u8"Out of entity slots");
+
+        auto index = (std::uint32_t) entity_generations.size();
+        entity_generations.push_back(1);
+
+        return make_entity_id(index, 1);
+    }
+
+    void generate_entity_ids(std::vector<entityid_t> &entityids, std::size_t count) {
+        entityids.reserve(entityids.size() + count);
+
+        std::size_t recycled_count = std::min(count, free_entity_indices.size());
+        for (std::size_t i = 0; i < recycled_count; i++) {
+            std::uint32_t index = free_entity_indices.back();
+            free_entity_indices.pop_back();
+            entityids.push_back(make_entity_id(index, entity_generations[index]));
+        }
+
+        std::size_t new_count = count - recycled_count;
+        if (entity_generations.size() + new_count > ((std::size_t) UINT32_MAX) + 1)
+            throw std::runtime_error(u8"Out of entity slots");
+
+        auto first_index = (std::uint32_t) entity_generations.size();
+        entity_generations.resize(entity_generations.size() + new_count, 1);
+        for (std::size_t i = 0; i < new_count; i++) {
+            entityids.push_back(make_entity_id(first_index + (std::uint32_t) i, 1));
+        }
     }
 
     void delete_entity(entityid_t entityid) {
-        deleted_ids.insert(entityid);
+        if (!is_entity_valid(entityid))
+            return;
+
+        std::uint32_t index = entity_index(entityid);
+        std::uint32_t &generation = entity_generations[index];
+        generation++;
+        if (generation == 0)
+            generation = 1;
+
+        free_entity_indices.push_back(index);
+    }
+
+    void delete_entities(const std::vector<entityid_t> &entityids) {
+        free_entity_indices.reserve(free_entity_indices.size() + entityids.size());
+
+        for (entityid_t entityid: entityids) {
+            delete_entity(entityid);
+        }
     }
 
     bool is_entity_valid(entityid_t entityid) {
-        return deleted_ids.empty() ||  deleted_ids.find(entityid) != deleted_ids.end();
+        std::uint32_t index = entity_index(entityid);
+        return index < entity_generations.size() && entity_generations[index] == entity_generation(entityid);
     }
 }
@@ -0,0 +1,116 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <flatshaper/geometry_arena.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+
+namespace flatshaper {
+    constexpr std::size_t arena_vertex_size = 5 * sizeof(float);
+
+    void geometry_arena::initialize(std::size_t initial_vertex_capacity, std::size_t initial_element_capacity) {
+        vertex_capacity = initial_vertex_capacity;
+        element_capacity = initial_element_capacity;
+
+        glGenVertexArrays(1, &vertex_array_name);
+        glGenBuffers(1, &vertex_buffer);
+        glGenBuffers(1, &element_buffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (vertex_capacity * arena_vertex_size), nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        bind_buffers();
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr) (element_capacity * sizeof(std::uint32_t)), nullptr, GL_STATIC_DRAW);
+        glBindVertexArray(0);
+    }
+
+    void geometry_arena::bind_buffers() const {
+        glBindVertexArray(vertex_array_name);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, element_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, arena_vertex_size, nullptr);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, arena_vertex_size, ((void *) (3 * sizeof(float))));
+        glEnableVertexAttribArray(1);
+    }
+
+    GLuint geometry_arena::grow_buffer(GLuint buffer, GLsizeiptr used, GLsizeiptr new_capacity) {
+        GLuint new_buffer;
+        glGenBuffers(1, &new_buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, new_capacity, nullptr, GL_STATIC_DRAW);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, used);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+        return new_buffer;
+    }
+
+    model_range geometry_arena::add(const void *vertices, std::size_t new_vertex_count, const std::vector<std::uint32_t> &element_data) {
+        if (vertex_count + new_vertex_count > (std::size_t) std::numeric_limits<GLint>::max() ||
+            element_count + element_data.size() > (std::size_t) std::numeric_limits<GLsizei>::max())
+            throw std::runtime_error(u8"Geometry arena is full");
+
+        bool grown = false;
+        if (vertex_count + new_vertex_count > vertex_capacity) {
+            std::size_t new_capacity = std::max(vertex_capacity * 2, vertex_count + new_vertex_count);
+            vertex_buffer = grow_buffer(vertex_buffer, (GLsizeiptr) (vertex_count * arena_vertex_size),
+                                        (GLsizeiptr) (new_capacity * arena_vertex_size));
+            vertex_capacity = new_capacity;
+            grown = true;
+        }
+
+        if (element_count + element_data.size() > element_capacity) {
+            std::size_t new_capacity = std::max(element_capacity * 2, element_count + element_data.size());
+            element_buffer = grow_buffer(element_buffer, (GLsizeiptr) (element_count * sizeof(std::uint32_t)),
+                                         (GLsizeiptr) (new_capacity * sizeof(std::uint32_t)));
+            element_capacity = new_capacity;
+            grown = true;
+        }
+
+        // The vertex array still points at the old buffers
+        if (grown)
+            bind_buffers();
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+        glBufferSubData(GL_ARRAY_BUFFER,
+                        (GLintptr) (vertex_count * arena_vertex_size),
+                        (GLsizeiptr) (new_vertex_count * arena_vertex_size),
+                        vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, element_buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER,
+                        (GLintptr) (element_count * sizeof(std::uint32_t)),
+                        (GLsizeiptr) (element_data.size() * sizeof(std::uint32_t)),
+                        element_data.data());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glBindVertexArray(0);
+
+        // Elements stay relative to the model's first vertex, the draw adds base_vertex
+        model_range range{++model_count, (GLint) vertex_count, (GLuint) element_count, (GLsizei) element_data.size()};
+        vertex_count += new_vertex_count;
+        element_count += element_data.size();
+        return range;
+    }
+}
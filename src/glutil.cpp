@@ -16,79 +16,41 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 
 #include <flatshaper/glutil.hpp>
-#include <flatshaper/plyutil.hpp>
 
 #include <IL/il.h>
+#include <glm/common.hpp>
 
+#include <cstring>
 #include <fstream>
 
 #ifdef FLATSHAPER_DEBUG_GL
-#define gl_clear_errors() while (int err = glGetError())
 #define gl_fail_on_gl_error() if (int err = glGetError()) throw std::runtime_error(std::string(u8"OpenGL error ") + std::to_string(err))
 #else
-#define gl_clear_errors()
 #define gl_fail_on_gl_error()
 #endif
 
 
 namespace flatshaper {
-    GLuint load_model(const std::filesystem::path &ply_file, int32_t &element_count) {
-        std::vector<float> vertex_data;
-        std::vector<uint32_t> element_data;
-        parse_ply(ply_file, vertex_data, element_data);
-        uint32_t element_count_u = element_data.size();
-        if (element_count_u > std::numeric_limits<int32_t>::max()) {
-            throw std::runtime_error(u8"Way too large a model. Workshop this.");
+    model_bounds compute_model_bounds(const void *vertices, std::size_t vertex_count) {
+        model_bounds bounds{glm::vec3(0.0f), glm::vec3(0.0f)};
+        const auto *vertex_bytes = (const char *) vertices;
+        for (std::size_t i = 0; i < vertex_count; i++) {
+            float position_values[3];
+            std::memcpy(position_values, vertex_bytes + i * 5 * sizeof(float), sizeof(position_values));
+
+            glm::vec3 position(position_values[0], position_values[1], position_values[2]);
+            bounds.min = i == 0 ? position : glm::min(bounds.min, position);
+            bounds.max = i == 0 ? position : glm::max(bounds.max, position);
         }
 
-        element_count = (int32_t) element_count_u;
-
-        gl_clear_errors();
-        gl_fail_on_gl_error();
-
-        GLuint vertex_array = 0;
-        GLuint data_buffers[2]{};
-        glGenVertexArrays(1, &vertex_array);
-        gl_fail_on_gl_error();
-        glBindVertexArray(vertex_array);
-        gl_fail_on_gl_error();
-        glGenBuffers(2, data_buffers);
-        gl_fail_on_gl_error();
-        glBindBuffer(GL_ARRAY_BUFFER, data_buffers[0]);
-        gl_fail_on_gl_error();
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, data_buffers[1]);
-        gl_fail_on_gl_error();
-        glBufferData(GL_ARRAY_BUFFER, (long) (vertex_data.size() * sizeof(float)), vertex_data.data(), GL_STATIC_DRAW);
-        gl_fail_on_gl_error();
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long) (element_data.size() * sizeof(float)), element_data.data(),
-                     GL_STATIC_DRAW);
-        gl_fail_on_gl_error();
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), nullptr);
-        gl_fail_on_gl_error();
-        glEnableVertexAttribArray(0);
-        gl_fail_on_gl_error();
-        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), ((void *) (3 * sizeof(float))));
-        gl_fail_on_gl_error();
-        glEnableVertexAttribArray(1);
-        gl_fail_on_gl_error();
-
-        return vertex_array;
+        return bounds;
     }
 
-    GLuint load_texture(const std::filesystem::path &texture_file) {
-        ILuint image_name = ilGenImage();
-        auto file = std::filesystem::absolute(texture_file);
-        ilBindImage(image_name);
-        ilLoadImage(file.c_str());
-
-        ILint image_width = ilGetInteger(IL_IMAGE_WIDTH);
-        ILint image_height = ilGetInteger(IL_IMAGE_HEIGHT);
+    // Translates the bound DevIL image's format and type into their GL counterparts
+    static void get_image_format(GLint &gl_texture_format, GLint &gl_texture_type) {
         ILint image_format = ilGetInteger(IL_IMAGE_FORMAT);
         ILint image_type = ilGetInteger(IL_IMAGE_TYPE);
 
-        GLint gl_texture_format;
-        GLint gl_texture_type;
         switch (image_type) {
             case IL_BYTE:
             case IL_UNSIGNED_BYTE:
@@ -117,6 +79,20 @@ namespace flatshaper {
             default:
                 throw std::runtime_error(u8"Invalid image data type");
         }
+    }
+
+    GLuint load_texture(const std::filesystem::path &texture_file) {
+        ILuint image_name = ilGenImage();
+        auto file = std::filesystem::absolute(texture_file);
+        ilBindImage(image_name);
+        ilLoadImage(file.c_str());
+
+        ILint image_width = ilGetInteger(IL_IMAGE_WIDTH);
+        ILint image_height = ilGetInteger(IL_IMAGE_HEIGHT);
+
+        GLint gl_texture_format;
+        GLint gl_texture_type;
+        get_image_format(gl_texture_format, gl_texture_type);
 
         ILubyte *data = ilGetData();
 
@@ -145,6 +121,72 @@ namespace flatshaper {
         return texture_name;
     }
 
+    std::vector<texture_layer> load_texture_arrays(const std::vector<std::filesystem::path> &texture_files) {
+        struct array_image {
+            ILuint image_name;
+            ILint width;
+            ILint height;
+            GLint format;
+            GLint type;
+        };
+
+        std::vector<array_image> images;
+        for (const auto &texture_file: texture_files) {
+            array_image image{ilGenImage(), 0, 0, 0, 0};
+            auto file = std::filesystem::absolute(texture_file);
+            ilBindImage(image.image_name);
+            ilLoadImage(file.c_str());
+
+            image.width = ilGetInteger(IL_IMAGE_WIDTH);
+            image.height = ilGetInteger(IL_IMAGE_HEIGHT);
+            get_image_format(image.format, image.type);
+            images.push_back(image);
+        }
+
+        // All layers of an array share size and format, so every such combination gets its own array
+        std::vector<texture_layer> layers(images.size(), texture_layer{0, -1});
+        for (std::size_t first = 0; first < images.size(); first++) {
+            if (layers[first].layer >= 0)
+                continue;
+
+            const array_image &group = images[first];
+            std::vector<std::size_t> members;
+            for (std::size_t i = first; i < images.size(); i++) {
+                if (layers[i].layer < 0 && images[i].width == group.width && images[i].height == group.height &&
+                    images[i].format == group.format && images[i].type == group.type)
+                    members.push_back(i);
+            }
+
+            GLuint texture_name;
+            glGenTextures(1, &texture_name);
+            gl_fail_on_gl_error();
+            glBindTexture(GL_TEXTURE_2D_ARRAY, texture_name);
+            gl_fail_on_gl_error();
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, group.format, group.width, group.height, (GLsizei) members.size(),
+                         0, group.format, group.type, nullptr);
+            gl_fail_on_gl_error();
+
+            for (std::size_t layer = 0; layer < members.size(); layer++) {
+                ilBindImage(images[members[layer]].image_name);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint) layer, group.width, group.height, 1,
+                                group.format, group.type, ilGetData());
+                gl_fail_on_gl_error();
+                layers[members[layer]] = texture_layer{texture_name, (GLint) layer};
+            }
+
+            // Layers are mipmapped separately, so unlike atlas pages nothing bleeds between them
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            gl_fail_on_gl_error();
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        }
+
+        ilBindImage(0);
+        for (const array_image &image: images)
+            ilDeleteImage(image.image_name);
+
+        return layers;
+    }
+
     GLuint load_shader(const std::filesystem::path &shader_file, GLenum shader_type) {
         uintmax_t file_size = std::filesystem::file_size(shader_file);
         if (file_size > 32 * 1024 * 1024) {
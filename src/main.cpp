@@ -23,10 +23,19 @@
 #include <GLFW/glfw3.h>
 #include <IL/il.h>
 
+#include <atomic>
+#include <chrono>
 #include <stdexcept>
+#include <thread>
 
 
 GLFWwindow *create_window();
+void render_loop(GLFWwindow *window);
+
+// The simulation runs at a fixed rate, independent of how fast the render thread presents
+constexpr std::chrono::microseconds simulation_tick_duration(16667);
+
+std::atomic<bool> render_running{true};
 
 int main() {
     GLFWwindow *window = create_window();
@@ -52,13 +61,36 @@ int main() {
     flatshaper::systems::physics_position[flat] = glm::vec3(0.0f, 0.0f, 8.0f);
     flatshaper::systems::render::render_add_entity(flat, 6);
 
+    // The render thread owns the GL context from here on, events stay on the main thread
+    glfwMakeContextCurrent(nullptr);
+    std::thread render_thread(render_loop, window);
+
+    auto next_tick = std::chrono::steady_clock::now();
     while (!glfwWindowShouldClose(window)) {
         flatshaper::systems::physics_simulate();
 
+        flatshaper::systems::render::render_time = (float) glfwGetTime();
+        flatshaper::systems::render::render_submit_frame();
+        glfwPollEvents();
+
+        next_tick += simulation_tick_duration;
+        std::this_thread::sleep_until(next_tick);
+    }
+
+    render_running = false;
+    render_thread.join();
+}
+
+void render_loop(GLFWwindow *window) {
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(1);
+
+    while (render_running) {
         flatshaper::systems::render::render_draw();
         glfwSwapBuffers(window);
-        glfwPollEvents();
     }
+
+    glfwMakeContextCurrent(nullptr);
 }
 
 GLFWwindow *create_window() {
@@ -0,0 +1,109 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <flatshaper/mapped_file.hpp>
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define FLATSHAPER_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace flatshaper {
+    mapped_file::mapped_file(const std::filesystem::path &file) {
+#ifdef FLATSHAPER_HAS_MMAP
+        int descriptor = open(file.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            throw std::runtime_error(u8"Cannot open " + file.string());
+
+        struct stat status{};
+        if (fstat(descriptor, &status) != 0) {
+            ::close(descriptor);
+            throw std::runtime_error(u8"Cannot read " + file.string());
+        }
+
+        length = (std::size_t) status.st_size;
+        // Empty files cannot be mapped, they are just empty
+        if (length > 0) {
+            void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (address != MAP_FAILED) {
+                // Files are read front to back
+                madvise(address, length, MADV_SEQUENTIAL);
+                bytes = (const char *) address;
+                mapped = true;
+            }
+        }
+
+        // The mapping keeps its own reference to the file
+        ::close(descriptor);
+        if (mapped || length == 0)
+            return;
+#endif
+
+        std::ifstream input_stream(file, std::ios::binary | std::ios::ate);
+        if (!input_stream)
+            throw std::runtime_error(u8"Cannot open " + file.string());
+
+        contents.resize((std::size_t) input_stream.tellg());
+        input_stream.seekg(0);
+        if (!input_stream.read(contents.data(), (std::streamsize) contents.size()))
+            throw std::runtime_error(u8"Cannot read " + file.string());
+
+        bytes = contents.data();
+        length = contents.size();
+    }
+
+    mapped_file::~mapped_file() {
+        close();
+    }
+
+    mapped_file::mapped_file(mapped_file &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    mapped_file &mapped_file::operator=(mapped_file &&other) noexcept {
+        if (this != &other) {
+            close();
+            // Moving the vector keeps its data where it is, so bytes stays valid
+            contents = std::move(other.contents);
+            bytes = std::exchange(other.bytes, nullptr);
+            length = std::exchange(other.length, 0);
+            mapped = std::exchange(other.mapped, false);
+        }
+
+        return *this;
+    }
+
+    void mapped_file::close() {
+#ifdef FLATSHAPER_HAS_MMAP
+        if (mapped)
+            munmap((void *) bytes, length);
+#endif
+
+        contents.clear();
+        bytes = nullptr;
+        length = 0;
+        mapped = false;
+    }
+}
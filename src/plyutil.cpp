@@ -16,383 +16,759 @@
 // 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 
 #include <flatshaper/plyutil.hpp>
+#include <flatshaper/thread_pool.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
 #include <charconv>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 namespace flatshaper {
-    std::ifstream &read_next_line(std::ifstream &input_stream, std::string &line) {
-        if (!std::getline(input_stream, line))
-            throw std::runtime_error(u8"Cannot read PLY input stream");
+    enum class ply_format : std::uint8_t {
+        ASCII,
+        BINARY_LITTLE_ENDIAN,
+        BINARY_BIG_ENDIAN
+    };
+
+    enum class ply_type : std::uint8_t {
+        CHAR,
+        UCHAR,
+        SHORT,
+        USHORT,
+        INT,
+        UINT,
+        FLOAT,
+        DOUBLE
+    };
+
+    struct ply_property {
+        std::string name;
+        ply_type type;
+        // List properties are a count of list_count_type followed by that many values of type
+        bool is_list;
+        ply_type list_count_type;
+        // In binary records, only meaningful for the properties before the first list
+        std::uint32_t offset;
+    };
+
+    struct ply_element {
+        std::string name;
+        std::uint32_t count;
+        std::vector<ply_property> properties;
+        // Record size in binary files, 0 if the element has list properties
+        std::uint32_t stride;
+    };
+
+    // The property table of a PLY header, elements in file order
+    struct ply_header {
+        ply_format format;
+        std::vector<ply_element> elements;
+
+        const ply_element *find_element(std::string_view name) const {
+            for (const ply_element &element: elements) {
+                if (element.name == name)
+                    return &element;
+            }
 
-        while (line.find(u8"comment") != std::string::npos) {
-            if (!std::getline(input_stream, line))
-                throw std::runtime_error(u8"Cannot read PLY input stream");
+            return nullptr;
         }
+    };
 
-        return input_stream;
+    constexpr std::size_t ply_type_sizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+
+    std::size_t ply_type_size(ply_type type) {
+        return ply_type_sizes[(std::size_t) type];
     }
 
-    template<typename T>
-    T two_bytes_to_numeral(uint8_t byte_0, uint8_t byte_1) {
-        static_assert(sizeof(T) == 2, u8"Numeral type is not 2 bytes");
-        uint8_t byte_array[2] = {byte_0, byte_1};
-        T out = 0;
-        std::copy(byte_array, byte_array + 1, (uint8_t *) (&out));
-        return out;
+    bool is_ply_integer_type(ply_type type) {
+        return type != ply_type::FLOAT && type != ply_type::DOUBLE;
     }
 
-    template<typename T>
-    T four_bytes_to_numeral(uint8_t byte_0, uint8_t byte_1, uint8_t byte_2, uint8_t byte_3) {
-        static_assert(sizeof(T) == 4, u8"Numeral type is not 4 bytes");
-        T out = 0;
-        (reinterpret_cast<uint8_t *>(&out))[0] = byte_0;
-        (reinterpret_cast<uint8_t *>(&out))[1] = byte_1;
-        (reinterpret_cast<uint8_t *>(&out))[2] = byte_2;
-        (reinterpret_cast<uint8_t *>(&out))[3] = byte_3;
-        return out;
+    ply_type parse_ply_type(std::string_view name) {
+        if (name == u8"char" || name == u8"int8")
+            return ply_type::CHAR;
+        if (name == u8"uchar" || name == u8"uint8")
+            return ply_type::UCHAR;
+        if (name == u8"short" || name == u8"int16")
+            return ply_type::SHORT;
+        if (name == u8"ushort" || name == u8"uint16")
+            return ply_type::USHORT;
+        if (name == u8"int" || name == u8"int32")
+            return ply_type::INT;
+        if (name == u8"uint" || name == u8"uint32")
+            return ply_type::UINT;
+        if (name == u8"float" || name == u8"float32")
+            return ply_type::FLOAT;
+        if (name == u8"double" || name == u8"float64")
+            return ply_type::DOUBLE;
+
+        throw std::runtime_error(u8"Invalid PLY file (unknown property type " + std::string(name) + u8")");
     }
 
-    void parse_ply_binary(std::ifstream &ply_input_stream,
-                          std::vector<float> &vertex_data,
-                          std::vector<uint32_t> &element_data,
-                          uint32_t vertex_count,
-                          uint32_t face_count,
-                          uint32_t property_list_vertex_indices_count_type,
-                          uint32_t property_list_vertex_indices_index_type,
-                          uint32_t property_count,
-                          uint32_t property_x_index,
-                          uint32_t property_y_index,
-                          uint32_t property_z_index,
-                          uint32_t property_s_index,
-                          uint32_t property_t_index) {
-        std::vector<uint8_t> buffer_bytes(property_count * sizeof(float));
-        for (uint32_t i = 0; i < vertex_count; i++) {
-            if (!ply_input_stream.read((std::ifstream::char_type *) buffer_bytes.data(), (long) buffer_bytes.size())) {
-                throw std::runtime_error(u8"Malformed PLY file (EOF?)");
-            }
+    // Calls function with a value of the C++ type matching type, to instantiate a template per type
+    template<typename Function>
+    void with_ply_type(ply_type type, Function function) {
+        switch (type) {
+            case ply_type::CHAR:
+                function(std::int8_t{});
+                break;
+            case ply_type::UCHAR:
+                function(std::uint8_t{});
+                break;
+            case ply_type::SHORT:
+                function(std::int16_t{});
+                break;
+            case ply_type::USHORT:
+                function(std::uint16_t{});
+                break;
+            case ply_type::INT:
+                function(std::int32_t{});
+                break;
+            case ply_type::UINT:
+                function(std::uint32_t{});
+                break;
+            case ply_type::FLOAT:
+                function(float{});
+                break;
+            case ply_type::DOUBLE:
+                function(double{});
+                break;
+        }
+    }
 
-            uint8_t *property_x_bytes = &buffer_bytes[property_x_index * 4];
-            uint8_t *property_y_bytes = &buffer_bytes[property_y_index * 4];
-            uint8_t *property_z_bytes = &buffer_bytes[property_z_index * 4];
-            uint8_t *property_s_bytes = &buffer_bytes[property_s_index * 4];
-            uint8_t *property_t_bytes = &buffer_bytes[property_t_index * 4];
-
-            auto x_value = four_bytes_to_numeral<float>(property_x_bytes[0], property_x_bytes[1], property_x_bytes[2], property_x_bytes[3]);
-            auto y_value = four_bytes_to_numeral<float>(property_y_bytes[0], property_y_bytes[1], property_y_bytes[2], property_y_bytes[3]);
-            auto z_value = four_bytes_to_numeral<float>(property_z_bytes[0], property_z_bytes[1], property_z_bytes[2], property_z_bytes[3]);
-            auto s_value = four_bytes_to_numeral<float>(property_s_bytes[0], property_s_bytes[1], property_s_bytes[2], property_s_bytes[3]);
-            auto t_value = four_bytes_to_numeral<float>(property_t_bytes[0], property_t_bytes[1], property_t_bytes[2], property_t_bytes[3]);
-
-            vertex_data.push_back(x_value);
-            vertex_data.push_back(y_value);
-            vertex_data.push_back(z_value);
-            vertex_data.push_back(s_value);
-            vertex_data.push_back(t_value);
+    bool read_next_line(const char *&cursor, const char *end, std::string &line) {
+        do {
+            if (cursor == end)
+                throw std::runtime_error(u8"Cannot read PLY input stream");
+
+            auto line_end = (const char *) std::memchr(cursor, '\n', end - cursor);
+            if (line_end == nullptr)
+                line_end = end;
+
+            line.assign(cursor, line_end);
+            cursor = line_end == end ? end : line_end + 1;
+        } while (line.find(u8"comment") != std::string::npos);
+
+        // Files written on Windows
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        return true;
+    }
+
+    std::vector<std::string_view> split_line(std::string_view line) {
+        std::vector<std::string_view> words;
+        std::size_t start = line.find_first_not_of(' ');
+        while (start != std::string_view::npos) {
+            std::size_t stop = line.find(' ', start);
+            words.push_back(line.substr(start, stop == std::string_view::npos ? stop : stop - start));
+            start = line.find_first_not_of(' ', stop);
         }
 
-        buffer_bytes.resize(property_list_vertex_indices_count_type + 3 * property_list_vertex_indices_index_type);
-        for (uint32_t i = 0; i < face_count; i++) {
-            if (!ply_input_stream.read((std::ifstream::char_type *) buffer_bytes.data(), (long) buffer_bytes.size())) {
-                throw std::runtime_error(u8"Malformed PLY file (EOF?)");
-            }
+        return words;
+    }
 
-            uint8_t *face_vertex_count_bytes = &buffer_bytes[0];
-            uint8_t *vertex_bytes[3] {};
-            vertex_bytes[0] = &buffer_bytes[property_list_vertex_indices_count_type];
-            vertex_bytes[1] = &buffer_bytes[property_list_vertex_indices_count_type + property_list_vertex_indices_index_type];
-            vertex_bytes[2] = &buffer_bytes[property_list_vertex_indices_count_type + 2 * property_list_vertex_indices_index_type];
-
-            uint32_t face_vertex_count;
-            if (property_list_vertex_indices_count_type == 1) {
-                face_vertex_count = *face_vertex_count_bytes;
-            } else if (property_list_vertex_indices_count_type == 2) {
-                face_vertex_count = two_bytes_to_numeral<uint16_t>(face_vertex_count_bytes[0], face_vertex_count_bytes[1]);
-            } else {
-                face_vertex_count = four_bytes_to_numeral<uint32_t>(face_vertex_count_bytes[0], face_vertex_count_bytes[1], face_vertex_count_bytes[2], face_vertex_count_bytes[3]);
-            }
+    // Reads the header up to and including end_header, leaving cursor at the payload
+    ply_header parse_ply_header(const char *&cursor, const char *end) {
+        ply_header header{};
 
-            if (face_vertex_count != 3) {
-                throw std::runtime_error(u8"Malformed PLY file (face doesn't have exactly 3 vertices)");
+        std::string line;
+        read_next_line(cursor, end, line);
+        if (line != u8"ply")
+            throw std::runtime_error(u8"File is not a PLY file");
+
+        read_next_line(cursor, end, line);
+        if (line == u8"format binary_little_endian 1.0")
+            header.format = ply_format::BINARY_LITTLE_ENDIAN;
+        else if (line == u8"format binary_big_endian 1.0")
+            header.format = ply_format::BINARY_BIG_ENDIAN;
+        else if (line == u8"format ascii 1.0")
+            header.format = ply_format::ASCII;
+        else
+            throw std::runtime_error(u8"Invalid PLY file (invalid/no format)");
+
+        while (read_next_line(cursor, end, line) && line != u8"end_header") {
+            std::vector<std::string_view> words = split_line(line);
+            if (words.empty() || words[0] == u8"obj_info")
+                continue;
+
+            if (words[0] == u8"element") {
+                if (words.size() != 3)
+                    throw std::runtime_error(u8"Invalid PLY file (malformed element)");
+
+                ply_element element{std::string(words[1]), 0, {}, 0};
+                if (std::from_chars(words[2].data(), words[2].data() + words[2].size(), element.count).ec != std::errc())
+                    throw std::runtime_error(u8"Invalid element count");
+
+                header.elements.push_back(element);
+                continue;
             }
 
-            uint32_t face_vertices[3] {};
-            if (property_list_vertex_indices_index_type == 1) {
-                face_vertices[0] = *vertex_bytes[0];
-                face_vertices[1] = *vertex_bytes[1];
-                face_vertices[2] = *vertex_bytes[2];
-            } else if (property_list_vertex_indices_index_type == 2) {
-                face_vertices[0] = two_bytes_to_numeral<uint16_t>(vertex_bytes[0][0], vertex_bytes[0][1]);
-                face_vertices[1] = two_bytes_to_numeral<uint16_t>(vertex_bytes[1][0], vertex_bytes[1][1]);
-                face_vertices[2] = two_bytes_to_numeral<uint16_t>(vertex_bytes[2][0], vertex_bytes[2][1]);
-            } else {
-                face_vertices[0] = four_bytes_to_numeral<uint32_t>(vertex_bytes[0][0], vertex_bytes[0][1], vertex_bytes[0][2], vertex_bytes[0][3]);
-                face_vertices[1] = four_bytes_to_numeral<uint32_t>(vertex_bytes[1][0], vertex_bytes[1][1], vertex_bytes[1][2], vertex_bytes[1][3]);
-                face_vertices[2] = four_bytes_to_numeral<uint32_t>(vertex_bytes[2][0], vertex_bytes[2][1], vertex_bytes[2][2], vertex_bytes[2][3]);
+            if (words[0] == u8"property") {
+                if (header.elements.empty())
+                    throw std::runtime_error(u8"Invalid PLY file (property outside of an element)");
+
+                ply_property property{};
+                if (words.size() == 5 && words[1] == u8"list") {
+                    property = ply_property{std::string(words[4]), parse_ply_type(words[3]), true, parse_ply_type(words[2]), 0};
+                    if (!is_ply_integer_type(property.list_count_type))
+                        throw std::runtime_error(u8"Invalid PLY file (list count is not an integer)");
+                } else if (words.size() == 3) {
+                    property = ply_property{std::string(words[2]), parse_ply_type(words[1]), false, ply_type::UCHAR, 0};
+                } else {
+                    throw std::runtime_error(u8"Invalid PLY file (malformed property)");
+                }
+
+                ply_element &element = header.elements.back();
+                for (const ply_property &other: element.properties) {
+                    if (other.name == property.name)
+                        throw std::runtime_error(u8"Invalid PLY file (property defined multiple times)");
+                }
+
+                property.offset = element.stride;
+                element.properties.push_back(property);
+
+                bool has_list = false;
+                for (const ply_property &other: element.properties)
+                    has_list = has_list || other.is_list;
+                element.stride = has_list ? 0 : element.stride + (std::uint32_t) ply_type_size(property.type);
+                continue;
             }
 
-            element_data.push_back(face_vertices[0]);
-            element_data.push_back(face_vertices[1]);
-            element_data.push_back(face_vertices[2]);
+            throw std::runtime_error(u8"Invalid PLY file (unknown header line)");
         }
+
+        return header;
     }
 
-    void parse_ply_ascii(std::ifstream &ply_input_stream,
-                         std::vector<float> &vertex_data,
-                         std::vector<uint32_t> &element_data,
-                         uint32_t vertex_count,
-                         uint32_t face_count,
-                         uint32_t property_count,
-                         uint32_t property_x_index,
-                         uint32_t property_y_index,
-                         uint32_t property_z_index,
-                         uint32_t property_s_index,
-                         uint32_t property_t_index) {
-        std::string ignored;
-        for (uint32_t i = 0; i < vertex_count; i++) {
-            float x = 0, y = 0, z = 0;
-            float s = 0, t = 0;
-
-            for (int p = 0; p < property_count; p++) {
-                if (p == property_x_index)
-                    ply_input_stream >> x;
-                else if (p == property_y_index)
-                    ply_input_stream >> y;
-                else if (p == property_z_index)
-                    ply_input_stream >> z;
-                else if (p == property_s_index)
-                    ply_input_stream >> s;
-                else if (p == property_t_index)
-                    ply_input_stream >> t;
-                else
-                    ply_input_stream >> ignored;
-            }
+    // Where the vertex properties we use end up. Positions and texture coordinates go into the
+    // interleaved GPU layout, normals and colors into their own streams.
+    struct ply_attribute {
+        std::string_view name;
+        // 0 for vertex_data, 1 for normal_data, 2 for color_data
+        std::size_t stream;
+        std::size_t component;
+        // Integer colors are scaled to 0 to 1
+        bool normalized;
+    };
+
+    constexpr std::size_t ply_vertex_stream = 0;
+    constexpr std::size_t ply_normal_stream = 1;
+    constexpr std::size_t ply_color_stream = 2;
+    constexpr std::size_t ply_stream_components[] = {5, 3, 4};
+
+    const ply_attribute ply_attributes[] = {
+            {u8"x", ply_vertex_stream, 0, false},
+            {u8"y", ply_vertex_stream, 1, false},
+            {u8"z", ply_vertex_stream, 2, false},
+            {u8"s", ply_vertex_stream, 3, false},
+            {u8"t", ply_vertex_stream, 4, false},
+            {u8"u", ply_vertex_stream, 3, false},
+            {u8"v", ply_vertex_stream, 4, false},
+            {u8"texture_u", ply_vertex_stream, 3, false},
+            {u8"texture_v", ply_vertex_stream, 4, false},
+            {u8"nx", ply_normal_stream, 0, false},
+            {u8"ny", ply_normal_stream, 1, false},
+            {u8"nz", ply_normal_stream, 2, false},
+            {u8"red", ply_color_stream, 0, true},
+            {u8"green", ply_color_stream, 1, true},
+            {u8"blue", ply_color_stream, 2, true},
+            {u8"alpha", ply_color_stream, 3, true},
+    };
+
+    const ply_attribute *find_ply_attribute(std::string_view name) {
+        for (const ply_attribute &attribute: ply_attributes) {
+            if (attribute.name == name)
+                return &attribute;
+        }
+
+        return nullptr;
+    }
 
-            vertex_data.push_back(x);
-            vertex_data.push_back(y);
-            vertex_data.push_back(z);
-            vertex_data.push_back(s);
-            vertex_data.push_back(t);
+    // Reverses the bytes of every Size-byte value in [source, source + bytes) into destination,
+    // which may be source itself. SSE2 has no byte shuffle, so 16 bytes at a time are put in order
+    // by 16-bit word shuffles and a byte swap within each word.
+    template<std::size_t Size>
+    void swap_byte_order(const char *source, char *destination, std::size_t bytes) {
+        static_assert(Size == 2 || Size == 4 || Size == 8, u8"Unsupported value size");
+
+        std::size_t i = 0;
+#ifdef __SSE2__
+        for (; i + 16 <= bytes; i += 16) {
+            __m128i values = _mm_loadu_si128((const __m128i *) (source + i));
+            if constexpr (Size == 4)
+                values = _mm_shufflehi_epi16(_mm_shufflelo_epi16(values, _MM_SHUFFLE(2, 3, 0, 1)), _MM_SHUFFLE(2, 3, 0, 1));
+            else if constexpr (Size == 8)
+                values = _mm_shufflehi_epi16(_mm_shufflelo_epi16(values, _MM_SHUFFLE(0, 1, 2, 3)), _MM_SHUFFLE(0, 1, 2, 3));
+
+            values = _mm_or_si128(_mm_slli_epi16(values, 8), _mm_srli_epi16(values, 8));
+            _mm_storeu_si128((__m128i *) (destination + i), values);
         }
+#endif
+        for (; i + Size <= bytes; i += Size) {
+            char value[Size];
+            std::memcpy(value, source + i, Size);
+            std::reverse(value, value + Size);
+            std::memcpy(destination + i, value, Size);
+        }
+    }
 
-        for (uint32_t i = 0; i < face_count; i++) {
-            uint32_t face_vertex_count = 0;
-            uint32_t face_first_vertex = 0, face_second_vertex = 0, face_third_vertex = 0;
+    void swap_byte_order(std::size_t value_size, const char *source, char *destination, std::size_t bytes) {
+        if (value_size == 2)
+            swap_byte_order<2>(source, destination, bytes);
+        else if (value_size == 4)
+            swap_byte_order<4>(source, destination, bytes);
+        else if (value_size == 8)
+            swap_byte_order<8>(source, destination, bytes);
+        else if (source != destination)
+            std::memcpy(destination, source, bytes);
+    }
 
-            ply_input_stream >> face_vertex_count;
-            if (face_vertex_count != 3)
-                throw std::runtime_error(u8"Malformed PLY file (face doesn't have exactly 3 vertices)");
+    // Reads a T from unaligned bytes, which are in big-endian order if Swap is set
+    template<typename T, bool Swap>
+    T load_ply_value(const char *bytes) {
+        T value;
+        if constexpr (Swap && sizeof(T) > 1) {
+            char swapped[sizeof(T)];
+            std::reverse_copy(bytes, bytes + sizeof(T), swapped);
+            std::memcpy(&value, swapped, sizeof(T));
+        } else {
+            std::memcpy(&value, bytes, sizeof(T));
+        }
 
-            ply_input_stream >> face_first_vertex;
-            ply_input_stream >> face_second_vertex;
-            ply_input_stream >> face_third_vertex;
+        return value;
+    }
 
-            element_data.push_back(face_first_vertex);
-            element_data.push_back(face_second_vertex);
-            element_data.push_back(face_third_vertex);
+    // Copies one property of the records [first, last) into every destination_stride-th float.
+    // One instantiation per source type, normalization and byte order, so the loop itself never
+    // branches on the schema.
+    template<typename Source, bool Normalized, bool Swap>
+    void gather_property(const char *property, std::size_t stride, std::size_t first, std::size_t last,
+                         float *destination, std::size_t destination_stride) {
+        for (std::size_t i = first; i < last; i++) {
+            auto value = load_ply_value<Source, Swap>(property + i * stride);
+
+            if constexpr (Normalized && std::is_integral_v<Source>)
+                destination[i * destination_stride] = (float) value * (1.0f / (float) std::numeric_limits<Source>::max());
+            else
+                destination[i * destination_stride] = (float) value;
         }
     }
 
-    void parse_ply(const std::filesystem::path &ply_file,
-                   std::vector<float> &vertex_data,
-                   std::vector<uint32_t> &element_data) {
-        std::ifstream ply_input_stream(ply_file);
-
-        bool header_read = false;
-        bool type_read = false;
-        bool is_ascii = false;
-        bool vertex_count_read = false;
-        uint32_t vertex_count = 0;
-        bool property_x_read = false;
-        uint32_t property_x_index = 0;
-        bool property_y_read = false;
-        uint32_t property_y_index = 0;
-        bool property_z_read = false;
-        uint32_t property_z_index = 0;
-        bool property_s_read = false;
-        uint32_t property_s_index = 0;
-        bool property_t_read = false;
-        uint32_t property_t_index = 0;
-        uint32_t property_count = 0;
-        bool face_count_read = false;
-        uint32_t face_count = 0;
-        uint32_t property_list_vertex_indices_count_type = 0;
-        uint32_t property_list_vertex_indices_index_type = 0;
-        bool property_list_vertex_indices_read = false;
-        bool end_header_read = false;
+    typedef void (*ply_gather_kernel)(const char *property, std::size_t stride, std::size_t first, std::size_t last,
+                                      float *destination, std::size_t destination_stride);
 
-        std::string line;
-        while (read_next_line(ply_input_stream, line)) {
-            if (!header_read) {
-                if (!std::equal(line.begin(), line.end(), u8"ply")) {
-                    throw std::runtime_error(u8"File is not a PLY file");
-                } else {
-                    header_read = true;
-                    continue;
-                }
-            }
+    ply_gather_kernel find_gather_kernel(ply_type type, bool normalized, bool swap) {
+        ply_gather_kernel kernel = nullptr;
+        with_ply_type(type, [&kernel, normalized, swap](auto value) {
+            typedef decltype(value) source_type;
+            if (swap)
+                kernel = normalized ? &gather_property<source_type, true, true> : &gather_property<source_type, false, true>;
+            else
+                kernel = normalized ? &gather_property<source_type, true, false> : &gather_property<source_type, false, false>;
+        });
 
-            if (header_read && !type_read) {
-                if (std::equal(line.begin(), line.end(), u8"format binary_little_endian 1.0")) {
-                    is_ascii = false;
-                    type_read = true;
-                } else if (std::equal(line.begin(), line.end(), "format ascii 1.0")) {
-                    is_ascii = true;
-                    type_read = true;
-                } else {
-                    throw std::runtime_error(u8"Invalid PLY file (invalid/no format)");
-                }
+        return kernel;
+    }
 
+    // One property of the vertex element to copy, resolved from the header once per file
+    struct ply_gather {
+        ply_gather_kernel kernel;
+        std::uint32_t offset;
+        // Normalized attributes are scaled in ASCII files as well
+        float scale;
+        float *destination;
+        std::size_t destination_stride;
+    };
+
+    // Sizes the mesh's streams for the vertex element and lists the properties that feed them, in
+    // record order. Properties that feed nothing get a null destination. With swap, the kernels
+    // read big-endian values.
+    std::vector<ply_gather> plan_vertex_gather(const ply_element &vertices, ply_mesh &mesh, bool swap) {
+        bool has_stream[3] = {true, false, false};
+        bool has_position[3] = {false, false, false};
+        for (const ply_property &property: vertices.properties) {
+            const ply_attribute *attribute = find_ply_attribute(property.name);
+            if (attribute == nullptr)
                 continue;
-            }
 
-            if (type_read && !vertex_count_read) {
-                if (line.find(u8"element vertex") == std::string::npos) {
-                    throw std::runtime_error(u8"Invalid PLY file (element vertex not available)");
-                }
+            if (property.is_list)
+                throw std::runtime_error(u8"Invalid PLY file (list vertex attribute " + property.name + u8")");
+
+            has_stream[attribute->stream] = true;
+            if (attribute->stream == ply_vertex_stream && attribute->component < 3)
+                has_position[attribute->component] = true;
+        }
 
-                auto whitespace_before_count_index = line.rfind(u8' ');
-                if (std::from_chars(line.c_str() + whitespace_before_count_index + 1, line.c_str() + line.length(), vertex_count).ec != std::errc())
-                    throw std::runtime_error(u8"Invalid vertex count");
+        if (!has_position[0] || !has_position[1] || !has_position[2])
+            throw std::runtime_error(u8"Invalid PLY file (missing something)");
 
-                vertex_count_read = true;
+        std::vector<float> *streams[3] = {&mesh.vertex_data, &mesh.normal_data, &mesh.color_data};
+        for (std::size_t stream = 0; stream < 3; stream++) {
+            if (has_stream[stream])
+                streams[stream]->assign((std::size_t) vertices.count * ply_stream_components[stream], 0.0f);
+        }
+
+        // Opaque unless the file says otherwise
+        for (std::size_t i = 3; i < mesh.color_data.size(); i += 4)
+            mesh.color_data[i] = 1.0f;
+
+        std::vector<ply_gather> gathers;
+        for (const ply_property &property: vertices.properties) {
+            const ply_attribute *attribute = find_ply_attribute(property.name);
+            if (attribute == nullptr || property.is_list) {
+                gathers.push_back(ply_gather{nullptr, property.offset, 1.0f, nullptr, 0});
                 continue;
             }
 
-            if (vertex_count_read && !face_count_read) {
-                if (line.find(u8"property") != std::string::npos) {
-                    // Limitation: We expect all properties to be 4 bytes long in binary representation,
-                    // thus, we reject non-4-byte-properties for all PLY files
-                    if (line.find(u8"float") == std::string::npos &&
-                        line.find(u8"uint") == std::string::npos &&
-                        line.find(u8"int") == std::string::npos)
-                        throw std::runtime_error(u8"Cannot parse PLY file: non-4-byte type used");
-
-                    if (std::equal(line.begin(), line.end(), u8"property float x")) {
-                        if (property_x_read)
-                            throw std::runtime_error(u8"Invalid PLY file (property defined multiple times)");
-
-                        property_x_read = true;
-                        property_x_index = property_count;
-                    } else if (std::equal(line.begin(), line.end(), u8"property float y")) {
-                        if (property_y_read)
-                            throw std::runtime_error(u8"Invalid PLY file (property defined multiple times)");
-
-                        property_y_read = true;
-                        property_y_index = property_count;
-                    } else if (std::equal(line.begin(), line.end(), u8"property float z")) {
-                        if (property_z_read)
-                            throw std::runtime_error(u8"Invalid PLY file (property defined multiple times)");
-
-                        property_z_read = true;
-                        property_z_index = property_count;
-                    } else if (std::equal(line.begin(), line.end(), u8"property float s")) {
-                        if (property_s_read)
-                            throw std::runtime_error(u8"Invalid PLY file (property defined multiple times)");
-
-                        property_s_read = true;
-                        property_s_index = property_count;
-                    } else if (std::equal(line.begin(), line.end(), u8"property float t")) {
-                        if (property_t_read)
-                            throw std::runtime_error(u8"Invalid PLY file (property defined multiple times)");
-
-                        property_t_read = true;
-                        property_t_index = property_count;
-                    }
+            float scale = 1.0f;
+            if (attribute->normalized) {
+                with_ply_type(property.type, [&scale](auto value) {
+                    typedef decltype(value) source_type;
+                    if constexpr (std::is_integral_v<source_type>)
+                        scale = 1.0f / (float) std::numeric_limits<source_type>::max();
+                });
+            }
 
-                    property_count++;
-                    continue;
-                }
+            gathers.push_back(ply_gather{find_gather_kernel(property.type, attribute->normalized, swap),
+                                         property.offset,
+                                         scale,
+                                         streams[attribute->stream]->data() + attribute->component,
+                                         ply_stream_components[attribute->stream]});
+        }
+
+        return gathers;
+    }
 
-                if (line.find(u8"element face") != std::string::npos) {
-                    auto whitespace_before_count_index = line.rfind(u8' ');
-                    if (std::from_chars(line.c_str() + whitespace_before_count_index + 1, line.c_str() + line.length(), face_count).ec != std::errc())
-                        throw std::runtime_error(u8"Invalid vertex count");
+    // Whether the records are exactly the GPU vertex layout, x, y, z, s, t as floats
+    bool is_gpu_vertex_layout(const ply_element &vertices) {
+        const char *names[] = {u8"x", u8"y", u8"z", u8"s", u8"t"};
+        if (vertices.properties.size() != 5)
+            return false;
 
-                    face_count_read = true;
-                    continue;
-                }
+        for (std::size_t i = 0; i < 5; i++) {
+            if (vertices.properties[i].name != names[i] || vertices.properties[i].type != ply_type::FLOAT)
+                return false;
+        }
+
+        return true;
+    }
+
+    // The size of every property of the element, or 0 if they differ
+    std::size_t uniform_property_size(const ply_element &element) {
+        std::size_t size = 0;
+        for (const ply_property &property: element.properties) {
+            if (size != 0 && size != ply_type_size(property.type))
+                return 0;
+
+            size = ply_type_size(property.type);
+        }
+
+        return size;
+    }
+
+    // The face element must be a list of vertex indices and nothing else
+    const ply_property &face_indices_property(const ply_element &faces) {
+        if (faces.properties.size() != 1 || !faces.properties[0].is_list ||
+            (faces.properties[0].name != u8"vertex_indices" && faces.properties[0].name != u8"vertex_index") ||
+            !is_ply_integer_type(faces.properties[0].type))
+            throw std::runtime_error(u8"Cannot parse PLY file: faces must only have integer vertex indices");
+
+        return faces.properties[0];
+    }
+
+    // Face records are a Count followed by three Index values. Records are not aligned, so
+    // everything is read with memcpy, which compiles to plain loads. Decodes the records [first,
+    // last) and returns false if one of them is not a triangle; this runs in pool jobs, which must
+    // not throw. With Swap, the records are big-endian.
+    template<typename Count, typename Index, bool Swap>
+    bool gather_faces(const char *payload, std::size_t first, std::size_t last, uint32_t *element_data) {
+        // 4-byte indices are copied as they are and swapped as one block afterwards
+        constexpr bool swap_indices_in_bulk = Swap && sizeof(Index) == 4;
+
+        constexpr std::size_t record_size = sizeof(Count) + 3 * sizeof(Index);
+        for (std::size_t i = first; i < last; i++) {
+            const char *record = payload + i * record_size;
+
+            if (load_ply_value<Count, Swap>(record) != 3)
+                return false;
+
+            for (std::size_t vertex = 0; vertex < 3; vertex++) {
+                const char *index = record + sizeof(Count) + vertex * sizeof(Index);
+                element_data[i * 3 + vertex] = (uint32_t) load_ply_value<Index, Swap && !swap_indices_in_bulk>(index);
             }
+        }
+
+        if constexpr (swap_indices_in_bulk) {
+            auto *indices = (char *) (element_data + first * 3);
+            swap_byte_order<4>(indices, indices, (last - first) * 3 * sizeof(uint32_t));
+        }
+
+        return true;
+    }
+
+    typedef bool (*ply_face_kernel)(const char *payload, std::size_t first, std::size_t last, uint32_t *element_data);
+
+    ply_face_kernel find_face_kernel(const ply_property &indices, bool swap) {
+        ply_face_kernel kernel = nullptr;
+        with_ply_type(indices.list_count_type, [&kernel, &indices, swap](auto count_value) {
+            with_ply_type(indices.type, [&kernel, swap](auto index_value) {
+                typedef decltype(count_value) count_type;
+                typedef decltype(index_value) index_type;
+                if constexpr (std::is_integral_v<count_type> && std::is_integral_v<index_type>)
+                    kernel = swap ? &gather_faces<count_type, index_type, true> : &gather_faces<count_type, index_type, false>;
+            });
+        });
 
-            if (face_count_read && !property_list_vertex_indices_read) {
-                if (line.find(u8"property list") != std::string::npos &&
-                    line.rfind(u8"vertex_indices") != std::string::npos) {
-                    auto first_type_whitespace = line.find(u8' ', sizeof(u8"property list") - 1);
-                    auto after_first_type_whitespace = line.find(u8' ', first_type_whitespace + 1);
-                    std::string first_type = line.substr(first_type_whitespace + 1, after_first_type_whitespace - first_type_whitespace - 1);
-                    if (std::equal(first_type.begin(), first_type.end(), u8"uchar"))
-                        property_list_vertex_indices_count_type = 1;
-                    else if (std::equal(first_type.begin(), first_type.end(), u8"ushort"))
-                        property_list_vertex_indices_count_type = 2;
-                    else if (std::equal(first_type.begin(), first_type.end(), u8"uint"))
-                        property_list_vertex_indices_count_type = 4;
-                    else
-                        throw std::runtime_error(u8"Invalid PLY file (unknown type for index count)");
-
-                    auto after_second_type_whitespace = line.rfind(u8' ');
-                    std::string second_type = line.substr(after_first_type_whitespace + 1, after_second_type_whitespace - after_first_type_whitespace - 1);
-                    if (std::equal(second_type.begin(), second_type.end(), u8"uchar"))
-                        property_list_vertex_indices_index_type = 1;
-                    else if (std::equal(second_type.begin(), second_type.end(), u8"ushort"))
-                        property_list_vertex_indices_index_type = 2;
-                    else if (std::equal(second_type.begin(), second_type.end(), u8"uint"))
-                        property_list_vertex_indices_index_type = 4;
-                    else
-                        throw std::runtime_error(u8"Invalid PLY file (unknown type for index type)");
-
-                    property_list_vertex_indices_read = true;
+        return kernel;
+    }
+
+    // Binary payloads are decoded in jobs of about this many bytes, so the number of threads
+    // working on a file grows with its size and small files stay on the calling thread
+    constexpr std::size_t ply_job_bytes = 1u << 20;
+
+    std::size_t ply_job_records(std::size_t stride) {
+        return std::max<std::size_t>(1, ply_job_bytes / stride);
+    }
+
+    // Assumes a little-endian host, like the rest of the loader
+    void parse_ply_binary(const char *payload, const char *end, const ply_header &header, ply_mesh &mesh) {
+        const ply_element *vertices = header.find_element(u8"vertex");
+        const ply_element *faces = header.find_element(u8"face");
+        const ply_property &indices = face_indices_property(*faces);
+
+        // Triangles only, so face records have a fixed size as well. Other elements are skipped,
+        // which needs them to have fixed-size records.
+        std::size_t face_stride = ply_type_size(indices.list_count_type) + 3 * ply_type_size(indices.type);
+        const char *vertex_records = nullptr;
+        const char *face_records = nullptr;
+        std::uint64_t offset = 0;
+        for (const ply_element &element: header.elements) {
+            std::size_t stride = &element == faces ? face_stride : element.stride;
+            if (stride == 0)
+                throw std::runtime_error(u8"Cannot parse PLY file: list properties in element " + element.name);
+
+            if (&element == vertices)
+                vertex_records = payload + offset;
+            else if (&element == faces)
+                face_records = payload + offset;
+
+            offset += (std::uint64_t) element.count * stride;
+            if (offset > (std::uint64_t) (end - payload))
+                throw std::runtime_error(u8"Malformed PLY file (EOF?)");
+        }
+
+        // Big-endian vertex records whose properties all have the same size are byte-swapped a
+        // job's range at a time, then decoded like little-endian ones. Only records mixing sizes
+        // need kernels that swap every value.
+        bool big_endian = header.format == ply_format::BINARY_BIG_ENDIAN;
+        std::size_t vertex_value_size = uniform_property_size(*vertices);
+        bool swap_vertex_blocks = big_endian && vertex_value_size > 1;
+        bool swap_into_vertex_data = false;
+
+        // Records have a fixed size, so every job finds its range by offset arithmetic and writes
+        // a disjoint slice of the preallocated arrays
+        std::vector<ply_gather> gathers;
+        mesh.vertex_count = vertices->count;
+        if (is_gpu_vertex_layout(*vertices) && !big_endian) {
+            // The file already stores the vertex layout we upload, so leave it where it is
+            mesh.vertices = vertex_records;
+        } else if (is_gpu_vertex_layout(*vertices)) {
+            // Only needs its byte order fixed
+            mesh.vertex_data.resize((std::size_t) vertices->count * 5);
+            mesh.vertices = mesh.vertex_data.data();
+            swap_into_vertex_data = true;
+        } else {
+            gathers = plan_vertex_gather(*vertices, mesh, big_endian && vertex_value_size == 0);
+            mesh.vertices = mesh.vertex_data.data();
+        }
+
+        mesh.element_data.resize((std::size_t) faces->count * 3);
+        ply_face_kernel face_kernel = find_face_kernel(indices, big_endian);
+
+        std::size_t vertex_job_records = ply_job_records(vertices->stride);
+        std::size_t vertex_jobs = gathers.empty() && !swap_into_vertex_data ? 0 : (vertices->count + vertex_job_records - 1) / vertex_job_records;
+        std::size_t face_job_records = ply_job_records(face_stride);
+        std::size_t face_jobs = (faces->count + face_job_records - 1) / face_job_records;
+
+        std::atomic<bool> triangles_only{true};
+        worker_pool().run(vertex_jobs + face_jobs, [&](std::size_t job) {
+            if (job < vertex_jobs) {
+                std::size_t first = job * vertex_job_records;
+                std::size_t last = std::min<std::size_t>(vertices->count, first + vertex_job_records);
+                const char *records = vertex_records + first * vertices->stride;
+                std::size_t bytes = (last - first) * vertices->stride;
+
+                if (swap_into_vertex_data) {
+                    swap_byte_order<4>(records, (char *) (mesh.vertex_data.data() + first * 5), bytes);
+                    return;
                 }
 
-                continue;
-            }
+                // Kept per thread between jobs and files, the larger of ply_job_bytes and one record
+                thread_local std::vector<char> swapped_records;
+                if (swap_vertex_blocks) {
+                    swapped_records.resize(bytes);
+                    swap_byte_order(vertex_value_size, records, swapped_records.data(), bytes);
+                    records = swapped_records.data();
+                }
 
-            if (property_list_vertex_indices_read && !end_header_read) {
-                if (std::equal(line.begin(), line.end(), u8"end_header")) {
-                    end_header_read = true;
-                    break;
+                for (const ply_gather &gather: gathers) {
+                    if (gather.kernel != nullptr)
+                        gather.kernel(records + gather.offset, vertices->stride, 0, last - first,
+                                      gather.destination + first * gather.destination_stride, gather.destination_stride);
                 }
+            } else {
+                std::size_t first = (job - vertex_jobs) * face_job_records;
+                std::size_t last = std::min<std::size_t>(faces->count, first + face_job_records);
+                if (!face_kernel(face_records, first, last, mesh.element_data.data()))
+                    triangles_only.store(false, std::memory_order_relaxed);
+            }
+        });
+
+        if (!triangles_only.load(std::memory_order_relaxed))
+            throw std::runtime_error(u8"Malformed PLY file (face doesn't have exactly 3 vertices)");
+    }
+
+    // Splits an ASCII payload into whitespace-separated tokens in place. With SSE2 it classifies 16
+    // bytes per step, which matters because tokens are short and mostly separated by one space.
+    struct ply_tokenizer {
+        const char *cursor;
+        const char *end;
+
+        static bool is_whitespace(char c) {
+            return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+        }
+
+#ifdef __SSE2__
+        // Bit i is set if byte i is whitespace
+        static std::uint32_t whitespace_mask(const char *bytes) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *) bytes);
+            __m128i whitespace = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                                                           _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n'))),
+                                              _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')),
+                                                           _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))));
+            return (std::uint32_t) _mm_movemask_epi8(whitespace);
+        }
+#endif
+
+        // Finds the first byte from position on that is whitespace (or not, if find_whitespace is false)
+        const char *find(const char *position, bool find_whitespace) const {
+#ifdef __SSE2__
+            while (end - position >= 16) {
+                std::uint32_t mask = whitespace_mask(position);
+                if (!find_whitespace)
+                    mask = ~mask & 0xFFFFu;
+
+                if (mask != 0)
+                    return position + __builtin_ctz(mask);
+
+                position += 16;
             }
+#endif
+            while (position != end && is_whitespace(*position) != find_whitespace)
+                position++;
+
+            return position;
+        }
+
+        // The next token as [first, last), throws at the end of the payload
+        void next(const char *&first, const char *&last) {
+            first = find(cursor, false);
+            if (first == end)
+                throw std::runtime_error(u8"Malformed PLY file (EOF?)");
+
+            last = find(first, true);
+            cursor = last;
+        }
+
+        void skip() {
+            const char *first, *last;
+            next(first, last);
         }
 
-        if (end_header_read) {
-            if (!property_x_read || !property_y_read || !property_z_read ||
-                !property_s_read || !property_t_read ||
-                !property_list_vertex_indices_read || !face_count_read || !vertex_count_read)
-                throw std::runtime_error(u8"Invalid PLY file (missing something)");
-
-            vertex_data.clear();
-            element_data.clear();
-            vertex_data.reserve(vertex_count * 5);
-            element_data.reserve(face_count * 3);
-
-            if (is_ascii) {
-                parse_ply_ascii(ply_input_stream,
-                                vertex_data,
-                                element_data,
-                                vertex_count,
-                                face_count,
-                                property_count,
-                                property_x_index,
-                                property_y_index,
-                                property_z_index,
-                                property_s_index,
-                                property_t_index);
+        // Locale-independent, unlike operator>>
+        template<typename T>
+        T next_number() {
+            const char *first, *last;
+            next(first, last);
+
+            T value{};
+            auto result = std::from_chars(first, last, value);
+            if (result.ec != std::errc() || result.ptr != last)
+                throw std::runtime_error(u8"Malformed PLY file (invalid number)");
+
+            return value;
+        }
+    };
+
+    void skip_ply_property(ply_tokenizer &tokenizer, const ply_property &property) {
+        std::uint32_t count = property.is_list ? tokenizer.next_number<std::uint32_t>() : 1;
+        for (std::uint32_t i = 0; i < count; i++)
+            tokenizer.skip();
+    }
+
+    void parse_ply_ascii(const char *payload, const char *end, const ply_header &header, ply_mesh &mesh) {
+        ply_tokenizer tokenizer{payload, end};
+
+        for (const ply_element &element: header.elements) {
+            if (element.name == u8"vertex") {
+                std::vector<ply_gather> gathers = plan_vertex_gather(element, mesh, false);
+                for (std::size_t i = 0; i < element.count; i++) {
+                    for (std::size_t p = 0; p < gathers.size(); p++) {
+                        const ply_gather &gather = gathers[p];
+                        if (gather.destination == nullptr)
+                            skip_ply_property(tokenizer, element.properties[p]);
+                        else
+                            gather.destination[i * gather.destination_stride] = tokenizer.next_number<float>() * gather.scale;
+                    }
+                }
+
+                mesh.vertices = mesh.vertex_data.data();
+                mesh.vertex_count = element.count;
+            } else if (element.name == u8"face") {
+                face_indices_property(element);
+
+                mesh.element_data.resize((std::size_t) element.count * 3);
+                uint32_t *face = mesh.element_data.data();
+                for (uint32_t i = 0; i < element.count; i++, face += 3) {
+                    if (tokenizer.next_number<uint32_t>() != 3)
+                        throw std::runtime_error(u8"Malformed PLY file (face doesn't have exactly 3 vertices)");
+
+                    face[0] = tokenizer.next_number<uint32_t>();
+                    face[1] = tokenizer.next_number<uint32_t>();
+                    face[2] = tokenizer.next_number<uint32_t>();
+                }
             } else {
-                parse_ply_binary(ply_input_stream,
-                                 vertex_data,
-                                 element_data,
-                                 vertex_count,
-                                 face_count,
-                                 property_list_vertex_indices_count_type,
-                                 property_list_vertex_indices_index_type,
-                                 property_count,
-                                 property_x_index,
-                                 property_y_index,
-                                 property_z_index,
-                                 property_s_index,
-                                 property_t_index);
+                for (std::size_t i = 0; i < element.count; i++) {
+                    for (const ply_property &property: element.properties)
+                        skip_ply_property(tokenizer, property);
+                }
             }
         }
     }
+
+    void parse_ply(const std::filesystem::path &ply_file, ply_mesh &mesh) {
+        mesh = ply_mesh{};
+        mesh.file = mapped_file(ply_file);
+        const char *cursor = mesh.file.data();
+        const char *end = cursor + mesh.file.size();
+
+        ply_header header = parse_ply_header(cursor, end);
+        if (header.find_element(u8"vertex") == nullptr || header.find_element(u8"face") == nullptr)
+            throw std::runtime_error(u8"Invalid PLY file (missing something)");
+
+        if (header.format == ply_format::ASCII)
+            parse_ply_ascii(cursor, end, header, mesh);
+        else
+            parse_ply_binary(cursor, end, header, mesh);
+    }
 }
@@ -1,9 +1,15 @@
 
 #include <flatshaper/systems/render/system_render.hpp>
 #include <flatshaper/glutil.hpp>
+#include <flatshaper/plyutil.hpp>
+#include <flatshaper/geometry_arena.hpp>
 
 #include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
 
+#include <algorithm>
+#include <string>
 #include <unordered_set>
 #include <unordered_map>
 #include <array>
@@ -21,28 +27,99 @@ namespace flatshaper::systems::render {
         LAST = 5
     };
 
+    // std140 layout of the ub_camera uniform block shared by all shader programs
+    struct camera_uniforms {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 view_projection;
+        float time;
+        float padding[3];
+    };
+
+    constexpr GLuint camera_uniform_block_binding = 0;
+    constexpr std::size_t geometry_arena_initial_vertices = 64 * 1024;
+    constexpr std::size_t geometry_arena_initial_elements = 256 * 1024;
+    // Grows on demand, see stream_reserve
+    constexpr GLsizeiptr instance_stream_initial_size = 256 * 1024;
+    // Fixed texture units of the ut_diffuse/ut_normal samplers
+    constexpr GLint diffuse_texture_unit = 0;
+    constexpr GLint normal_texture_unit = 1;
+
     // This is essentially read-only after initialization
     struct {
         std::unordered_map<assetid_t, ASSET_TYPE> assets_to_asset_types;
         std::unordered_map<assetid_t, std::filesystem::path> assets_to_files;
+        // Textures packed into an atlas page (see flatshaper_atlas): (u, v, width, height) of the image
+        std::unordered_map<assetid_t, glm::vec4> assets_to_uv_rects;
     } assets_database;
 
+    const glm::vec4 full_uv_rect(0.0f, 0.0f, 1.0f, 1.0f);
+
     struct {
         std::unordered_map<ASSET_TYPE, std::unordered_map<assetid_t, GLuint>> assets_dependencies;
-        std::unordered_map<assetid_t, int32_t> assets_to_element_counts;
+        // Every model is suballocated from the arena, MODEL dependencies all name its vertex array
+        geometry_arena geometry;
+        std::unordered_map<assetid_t, model_range> assets_to_model_ranges;
+        std::unordered_map<assetid_t, model_bounds> assets_to_bounds;
+        // Keyed by the model's asset ID in the assets database, so shared models are uploaded once
+        std::unordered_map<assetid_t, std::pair<model_range, model_bounds>> loaded_models;
+        // Per DIFFUSE/NORMAL dependency, the part of the bound texture the asset samples
+        std::unordered_map<ASSET_TYPE, std::unordered_map<assetid_t, glm::vec4>> assets_to_uv_rects;
+        // Atlas pages are shared by many texture assets, but loaded once
+        std::unordered_map<std::string, GLuint> files_to_textures;
+        // Per DIFFUSE/NORMAL dependency, the layer to sample if the texture is a GL_TEXTURE_2D_ARRAY
+        std::unordered_map<ASSET_TYPE, std::unordered_map<assetid_t, float>> assets_to_texture_layers;
+        std::unordered_set<GLuint> array_textures;
+        // Programs whose ut_diffuse is a sampler2DArray, their assets' textures are loaded as array layers
+        std::unordered_set<GLuint> array_shader_programs;
 
         std::unordered_map<GLuint, GLuint> shader_programs_to_vertex_shaders;
         std::unordered_map<GLuint, GLuint> shader_programs_to_fragment_shaders;
         std::unordered_map<assetid_t, GLuint> assets_to_shader_programs;
 
-        std::unordered_map<GLuint, GLint> shader_programs_to_model_matrix_uniform_locations;
-        std::unordered_map<GLuint, GLint> shader_programs_to_view_matrix_uniform_locations;
-        std::unordered_map<GLuint, GLint> shader_programs_to_projection_matrix_uniform_locations;
-        std::unordered_map<GLuint, GLint> shader_programs_to_diffuse_texture_uniform_locations;
-        std::unordered_map<GLuint, GLint> shader_programs_to_normal_texture_uniform_locations;
+        // Per-instance data (render_instance), one section per frame, see render_draw
+        stream_buffer instance_stream;
+        // Per-frame camera_uniforms, bound to camera_uniform_block_binding
+        GLuint camera_uniform_buffer;
     } gl_names;
 
 
+    void sprites_initialize(const std::filesystem::path &assets_directory);
+
+    GLuint link_shader_program(GLuint vertex_shader, GLuint fragment_shader) {
+        GLuint shader_program = glCreateProgram();
+        glAttachShader(shader_program, vertex_shader);
+        glAttachShader(shader_program, fragment_shader);
+        glLinkProgram(shader_program);
+
+        GLuint camera_block_index = glGetUniformBlockIndex(shader_program, u8"ub_camera");
+        if (camera_block_index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader_program, camera_block_index, camera_uniform_block_binding);
+
+        // Samplers always read from the same units, so they only need to be set once
+        glUseProgram(shader_program);
+        glUniform1i(glGetUniformLocation(shader_program, u8"ut_diffuse"), diffuse_texture_unit);
+        glUniform1i(glGetUniformLocation(shader_program, u8"ut_normal"), normal_texture_unit);
+
+        return shader_program;
+    }
+
+    bool uses_texture_arrays(GLuint shader_program) {
+        GLint uniform_count = 0;
+        glGetProgramiv(shader_program, GL_ACTIVE_UNIFORMS, &uniform_count);
+
+        for (GLint i = 0; i < uniform_count; i++) {
+            GLchar name[64];
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(shader_program, (GLuint) i, sizeof(name), nullptr, &size, &type, name);
+            if (std::string(name) == u8"ut_diffuse")
+                return type == GL_SAMPLER_2D_ARRAY;
+        }
+
+        return false;
+    }
+
     void render_initialize(const std::filesystem::path& assets_directory) {
         std::filesystem::path assets_file = std::filesystem::absolute(assets_directory / u8"assets.csv");
         if (!std::filesystem::exists(assets_file))
@@ -75,14 +152,43 @@ namespace flatshaper::systems::render {
                 throw std::runtime_error(u8"Invalid asset type");
 
             start_idx = idx + 1;
-            std::string asset_file_string = line.substr(start_idx);
+            idx = line.find(u8';', start_idx);
+            std::string asset_file_string = line.substr(start_idx, idx - start_idx);
             std::filesystem::path asset_file = assets_directory / asset_file_string;
 
+            // Optional UV rectangle columns after the file: u;v;width;height
+            if (idx != std::string::npos) {
+                glm::vec4 uv_rect{};
+                for (int i = 0; i < 4; i++) {
+                    if (idx == line.length())
+                        throw std::runtime_error(u8"Invalid UV rectangle");
+
+                    start_idx = idx + 1;
+                    idx = std::min(line.find(u8';', start_idx), line.length());
+                    if (std::from_chars(line.c_str() + start_idx, line.c_str() + idx, uv_rect[i]).ec != std::errc())
+                        throw std::runtime_error(u8"Invalid UV rectangle");
+                }
+
+                assets_database.assets_to_uv_rects[assetid] = uv_rect;
+            }
+
             assets_database.assets_to_asset_types[assetid] = asset_type;
             assets_database.assets_to_files[assetid] = asset_file;
         }
 
         assets_file_stream.close();
+
+        gl_names.geometry.initialize(geometry_arena_initial_vertices, geometry_arena_initial_elements);
+
+        stream_create(gl_names.instance_stream, instance_stream_initial_size);
+
+        glGenBuffers(1, &gl_names.camera_uniform_buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, gl_names.camera_uniform_buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(camera_uniforms), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, camera_uniform_block_binding, gl_names.camera_uniform_buffer);
+
+        sprites_initialize(assets_directory);
+        state_invalidate();
     }
 
     typedef GLuint (*asset_load_function)(const std::filesystem::path &asset_path);
@@ -105,6 +211,65 @@ namespace flatshaper::systems::render {
         }
     }
 
+    GLuint load_shared_texture(const std::filesystem::path &texture_file) {
+        auto texture = gl_names.files_to_textures.find(texture_file.string());
+        if (texture != gl_names.files_to_textures.end())
+            return texture->second;
+
+        GLuint texture_name = load_texture(texture_file);
+        gl_names.files_to_textures[texture_file.string()] = texture_name;
+        return texture_name;
+    }
+
+    void load_uv_rects(const std::unordered_map<assetid_t, assetid_t> &assets_to_load,
+                       std::unordered_map<assetid_t, glm::vec4> &assets_to_uv_rects) {
+        for (const auto &item: assets_to_load) {
+            auto uv_rect = assets_database.assets_to_uv_rects.find(item.second);
+            assets_to_uv_rects[item.first] = uv_rect == assets_database.assets_to_uv_rects.end() ? full_uv_rect : uv_rect->second;
+        }
+    }
+
+    // Loads the textures of assets drawn with array programs as layers of shared texture arrays
+    void load_array_textures(std::unordered_map<ASSET_TYPE, std::unordered_map<assetid_t, assetid_t>> &asset_dependencies_to_load) {
+        std::vector<std::filesystem::path> files;
+        std::unordered_map<std::string, std::size_t> files_to_indices;
+        for (ASSET_TYPE asset_type: {ASSET_TYPE::DIFFUSE, ASSET_TYPE::NORMAL}) {
+            for (const auto &item: asset_dependencies_to_load[asset_type]) {
+                if (gl_names.array_shader_programs.count(gl_names.assets_to_shader_programs[item.first]) == 0)
+                    continue;
+
+                const std::filesystem::path &file = assets_database.assets_to_files[item.second];
+                if (files_to_indices.emplace(file.string(), files.size()).second)
+                    files.push_back(file);
+            }
+        }
+
+        if (files.empty())
+            return;
+
+        std::vector<texture_layer> layers = load_texture_arrays(files);
+        for (const texture_layer &layer: layers)
+            gl_names.array_textures.insert(layer.texture);
+
+        // Take them out of the regular texture loading
+        for (ASSET_TYPE asset_type: {ASSET_TYPE::DIFFUSE, ASSET_TYPE::NORMAL}) {
+            auto &assets_to_load = asset_dependencies_to_load[asset_type];
+            for (auto item = assets_to_load.begin(); item != assets_to_load.end();) {
+                auto index = files_to_indices.find(assets_database.assets_to_files[item->second].string());
+                if (gl_names.array_shader_programs.count(gl_names.assets_to_shader_programs[item->first]) == 0 ||
+                    index == files_to_indices.end()) {
+                    item++;
+                    continue;
+                }
+
+                const texture_layer &layer = layers[index->second];
+                gl_names.assets_dependencies[asset_type][item->first] = layer.texture;
+                gl_names.assets_to_texture_layers[asset_type][item->first] = (float) layer.layer;
+                item = assets_to_load.erase(item);
+            }
+        }
+    }
+
     void render_load_assets(const std::filesystem::path& assets_list_file) {
         std::unordered_set<assetid_t> assets_in_file;
 
@@ -149,23 +314,22 @@ namespace flatshaper::systems::render {
         asset_list_file_input_stream.close();
 
         for (const auto &item: asset_dependencies_to_load[ASSET_TYPE::MODEL]) {
-            auto x = gl_names.assets_dependencies[ASSET_TYPE::MODEL].find(item.second);
-            GLuint name;
+            auto model = gl_names.loaded_models.find(item.second);
 
-            if (x == gl_names.assets_dependencies[ASSET_TYPE::MODEL].end()) {
-                int32_t element_count = 0;
-                GLuint vertex_array = load_model(assets_database.assets_to_files[item.second], element_count);
-                name = vertex_array;
-                gl_names.assets_to_element_counts[item.first] = element_count;
-            } else {
-                name = x->second;
+            if (model == gl_names.loaded_models.end()) {
+                // Uploaded straight from the mapped file where the layout allows it
+                ply_mesh mesh;
+                parse_ply(assets_database.assets_to_files[item.second], mesh);
+
+                model_range range = gl_names.geometry.add(mesh.vertices, mesh.vertex_count, mesh.element_data);
+                model = gl_names.loaded_models.emplace(item.second, std::make_pair(range, compute_model_bounds(mesh.vertices, mesh.vertex_count))).first;
             }
 
-            gl_names.assets_dependencies[ASSET_TYPE::MODEL][item.first] = name;
+            gl_names.assets_dependencies[ASSET_TYPE::MODEL][item.first] = gl_names.geometry.vertex_array();
+            gl_names.assets_to_model_ranges[item.first] = model->second.first;
+            gl_names.assets_to_bounds[item.first] = model->second.second;
         }
 
-        load_asset_type(asset_dependencies_to_load[ASSET_TYPE::DIFFUSE], gl_names.assets_dependencies[ASSET_TYPE::DIFFUSE], load_texture);
-        load_asset_type(asset_dependencies_to_load[ASSET_TYPE::NORMAL], gl_names.assets_dependencies[ASSET_TYPE::NORMAL], load_texture);
         load_asset_type(asset_dependencies_to_load[ASSET_TYPE::VERTEX], gl_names.assets_dependencies[ASSET_TYPE::VERTEX], [](const std::filesystem::path &path) { return load_shader(path, GL_VERTEX_SHADER); });
         load_asset_type(asset_dependencies_to_load[ASSET_TYPE::FRAGMENT], gl_names.assets_dependencies[ASSET_TYPE::FRAGMENT], [](const std::filesystem::path &path) { return load_shader(path, GL_FRAGMENT_SHADER); });
 
@@ -185,29 +349,26 @@ namespace flatshaper::systems::render {
 
             // Otherwise, create a new program and link it
             if (shader_program == 0) {
-                shader_program = glCreateProgram();
-                glAttachShader(shader_program, vertex_shader);
-                glAttachShader(shader_program, fragment_shader);
-                glLinkProgram(shader_program);
+                shader_program = link_shader_program(vertex_shader, fragment_shader);
 
                 gl_names.shader_programs_to_vertex_shaders[shader_program] = vertex_shader;
                 gl_names.shader_programs_to_fragment_shaders[shader_program] = fragment_shader;
-
-                auto model_location = glGetUniformLocation(shader_program, u8"um_model");
-                auto view_location = glGetUniformLocation(shader_program, u8"um_view");
-                auto projection_location = glGetUniformLocation(shader_program, u8"um_projection");
-                auto diffuse_location = glGetUniformLocation(shader_program, u8"ut_diffuse");
-                auto normal_location = glGetUniformLocation(shader_program, u8"ut_normal");
-
-                gl_names.shader_programs_to_model_matrix_uniform_locations[shader_program] = model_location;
-                gl_names.shader_programs_to_view_matrix_uniform_locations[shader_program] = view_location;
-                gl_names.shader_programs_to_projection_matrix_uniform_locations[shader_program] = projection_location;
-                gl_names.shader_programs_to_diffuse_texture_uniform_locations[shader_program] = diffuse_location;
-                gl_names.shader_programs_to_normal_texture_uniform_locations[shader_program] = normal_location;
+                if (uses_texture_arrays(shader_program))
+                    gl_names.array_shader_programs.insert(shader_program);
             }
 
             gl_names.assets_to_shader_programs[asset_to_vertex_shader.first] = shader_program;
         }
+
+        // Textures come after the programs, which decide whether they are loaded as 2D textures or array layers
+        load_uv_rects(asset_dependencies_to_load[ASSET_TYPE::DIFFUSE], gl_names.assets_to_uv_rects[ASSET_TYPE::DIFFUSE]);
+        load_uv_rects(asset_dependencies_to_load[ASSET_TYPE::NORMAL], gl_names.assets_to_uv_rects[ASSET_TYPE::NORMAL]);
+        load_array_textures(asset_dependencies_to_load);
+        load_asset_type(asset_dependencies_to_load[ASSET_TYPE::DIFFUSE], gl_names.assets_dependencies[ASSET_TYPE::DIFFUSE], load_shared_texture);
+        load_asset_type(asset_dependencies_to_load[ASSET_TYPE::NORMAL], gl_names.assets_dependencies[ASSET_TYPE::NORMAL], load_shared_texture);
+
+        // Loading bound buffers, vertex arrays, textures and programs behind the state cache's back
+        state_invalidate();
         // TODO: Implement unloading
     }
 }
@@ -0,0 +1,163 @@
+
+#include <flatshaper/systems/render/system_render.hpp>
+#include <flatshaper/glutil.hpp>
+
+#include <glm/ext.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+
+namespace flatshaper::systems::render {
+    // World-space axis-aligned bounding box, as center and half extents
+    struct world_bounds {
+        glm::vec3 center;
+        glm::vec3 extent;
+    };
+
+    struct view_frustum {
+        // Inward-facing planes (xyz normal, w distance): left, right, bottom, top, near, far
+        std::array<glm::vec4, 6> planes;
+        // Bounding rectangle of the frustum's corners in the xy plane
+        glm::vec2 min;
+        glm::vec2 max;
+    };
+
+    world_bounds transform_bounds(const model_bounds &bounds, const glm::mat4 &matrix) {
+        glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+        glm::vec3 extent = (bounds.max - bounds.min) * 0.5f;
+
+        world_bounds transformed{};
+        for (int row = 0; row < 3; row++) {
+            transformed.center[row] = matrix[3][row];
+            for (int column = 0; column < 3; column++) {
+                transformed.center[row] += matrix[column][row] * center[column];
+                transformed.extent[row] += std::abs(matrix[column][row]) * extent[column];
+            }
+        }
+
+        return transformed;
+    }
+
+    view_frustum make_view_frustum(const glm::mat4 &view_projection) {
+        view_frustum frustum{};
+
+        // Gribb/Hartmann: each plane is the fourth row of the matrix plus or minus one of the others
+        for (int axis = 0; axis < 3; axis++) {
+            for (int column = 0; column < 4; column++) {
+                frustum.planes[2 * axis][column] = view_projection[column][3] + view_projection[column][axis];
+                frustum.planes[2 * axis + 1][column] = view_projection[column][3] - view_projection[column][axis];
+            }
+        }
+
+        glm::mat4 inverse_view_projection = glm::inverse(view_projection);
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec4 ndc_corner((corner & 1) ? 1.0f : -1.0f,
+                                 (corner & 2) ? 1.0f : -1.0f,
+                                 (corner & 4) ? 1.0f : -1.0f,
+                                 1.0f);
+            glm::vec4 world_corner = inverse_view_projection * ndc_corner;
+            glm::vec2 point(world_corner.x / world_corner.w, world_corner.y / world_corner.w);
+
+            frustum.min = corner == 0 ? point : glm::min(frustum.min, point);
+            frustum.max = corner == 0 ? point : glm::max(frustum.max, point);
+        }
+
+        return frustum;
+    }
+
+    bool is_visible(const view_frustum &frustum, const world_bounds &bounds) {
+        for (const glm::vec4 &plane: frustum.planes) {
+            float distance = plane.x * bounds.center.x + plane.y * bounds.center.y + plane.z * bounds.center.z + plane.w;
+            float radius = std::abs(plane.x) * bounds.extent.x +
+                           std::abs(plane.y) * bounds.extent.y +
+                           std::abs(plane.z) * bounds.extent.z;
+
+            if (distance + radius < 0.0f)
+                return false;
+        }
+
+        return true;
+    }
+
+    // Uniform grid over the xy plane for entities that don't move. Every entity is filed only
+    // under the cell of its center, queries are widened by the largest extent instead.
+    constexpr float static_grid_cell_size = 4.0f;
+
+    struct {
+        std::unordered_map<std::uint64_t, std::vector<entityid_t>> cells;
+        float max_extent = 0.0f;
+    } static_grid;
+
+    std::int32_t static_grid_coordinate(float value) {
+        float cell = std::floor(value / static_grid_cell_size);
+        return (std::int32_t) std::clamp(cell, (float) INT32_MIN / 2, (float) INT32_MAX / 2);
+    }
+
+    std::uint64_t static_grid_cell_key(std::int32_t x, std::int32_t y) {
+        return (((std::uint64_t) (std::uint32_t) x) << 32) | (std::uint32_t) y;
+    }
+
+    void static_grid_insert(entityid_t entityid, const world_bounds &bounds, std::uint64_t &cell_key, std::uint32_t &cell_index) {
+        cell_key = static_grid_cell_key(static_grid_coordinate(bounds.center.x), static_grid_coordinate(bounds.center.y));
+        std::vector<entityid_t> &cell = static_grid.cells[cell_key];
+        cell_index = (std::uint32_t) cell.size();
+        cell.push_back(entityid);
+
+        static_grid.max_extent = std::max(static_grid.max_extent, std::max(bounds.extent.x, bounds.extent.y));
+    }
+
+    // Returns the entity that was moved into the freed position, or null_entity
+    entityid_t static_grid_remove(std::uint64_t cell_key, std::uint32_t cell_index) {
+        std::vector<entityid_t> &cell = static_grid.cells[cell_key];
+        entityid_t moved_entity = null_entity;
+        if (cell_index + 1 != cell.size()) {
+            moved_entity = cell.back();
+            cell[cell_index] = moved_entity;
+        }
+
+        cell.pop_back();
+        return moved_entity;
+    }
+
+    // Calls function(entityid) for every static entity that may overlap the rectangle
+    template<typename Function>
+    void static_grid_query(glm::vec2 min, glm::vec2 max, Function function) {
+        std::int32_t min_x = static_grid_coordinate(min.x - static_grid.max_extent);
+        std::int32_t min_y = static_grid_coordinate(min.y - static_grid.max_extent);
+        std::int32_t max_x = static_grid_coordinate(max.x + static_grid.max_extent);
+        std::int32_t max_y = static_grid_coordinate(max.y + static_grid.max_extent);
+
+        auto cell_count = ((std::uint64_t) (max_x - min_x + 1)) * ((std::uint64_t) (max_y - min_y + 1));
+        if (cell_count > static_grid.cells.size()) {
+            // Zoomed out further than the level is populated, visiting the populated cells is cheaper
+            for (const auto &cell: static_grid.cells) {
+                auto x = (std::int32_t) (std::uint32_t) (cell.first >> 32);
+                auto y = (std::int32_t) (std::uint32_t) cell.first;
+                if (x < min_x || x > max_x || y < min_y || y > max_y)
+                    continue;
+
+                for (entityid_t entityid: cell.second) {
+                    function(entityid);
+                }
+            }
+
+            return;
+        }
+
+        for (std::int32_t x = min_x; x <= max_x; x++) {
+            for (std::int32_t y = min_y; y <= max_y; y++) {
+                auto cell = static_grid.cells.find(static_grid_cell_key(x, y));
+                if (cell == static_grid.cells.end())
+                    continue;
+
+                for (entityid_t entityid: cell->second) {
+                    function(entityid);
+                }
+            }
+        }
+    }
+}
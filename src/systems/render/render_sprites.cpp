@@ -0,0 +1,204 @@
+
+#include <flatshaper/systems/render/system_render.hpp>
+#include <flatshaper/radix_sort.hpp>
+#include <flatshaper/glutil.hpp>
+
+#include <glad/glad.h>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+
+namespace flatshaper::systems::render {
+    // Sprites are requested by the simulation (see render_draw_sprite) and handed over with the
+    // frame's snapshot. The render thread resolves their textures, sorts them by texture, transforms
+    // them on the CPU into the stream buffer and draws them with one call per texture (and per
+    // sprites_per_draw). A frame's sprites all go into one stream section, which grows to fit them.
+    struct sprite_request {
+        assetid_t assetid;
+        glm::vec3 position;
+        glm::vec2 size;
+        float rotation;
+        glm::vec4 uv_rect;
+    };
+
+    struct queued_sprite {
+        glm::vec3 position;
+        glm::vec2 size;
+        float rotation;
+        glm::vec4 uv_rect;
+        GLuint texture;
+    };
+
+    struct sprite_vertex {
+        float x, y, z;
+        float u, v;
+    };
+
+    struct sprite_order {
+        std::uint64_t key;
+        std::uint32_t sprite;
+    };
+
+    // The static index buffer covers this many sprites, which bounds the size of a single draw
+    constexpr std::size_t sprites_per_draw = 65536;
+    constexpr std::size_t sprite_stream_initial_sprites = 65536;
+    constexpr GLsizeiptr sprite_size = 4 * sizeof(sprite_vertex);
+
+    struct {
+        GLuint program;
+        GLuint vertex_array;
+        GLuint index_buffer;
+        stream_buffer vertices;
+
+        std::vector<queued_sprite> queued;
+        std::vector<sprite_order> order;
+        std::vector<sprite_order> order_scratch;
+
+        // Consecutive sprites mostly share an asset, so spare the texture lookup for those
+        assetid_t last_assetid;
+        GLuint last_texture;
+        glm::vec4 last_uv_rect;
+    } sprite_batcher;
+
+    // Points the vertex array at the stream buffer, again whenever stream_reserve replaced it
+    void point_sprite_attributes() {
+        state_bind_array_buffer(sprite_batcher.vertices.buffer);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex), nullptr);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(sprite_vertex), (void *) (3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+    }
+
+    void sprites_initialize(const std::filesystem::path &assets_directory) {
+        GLuint vertex_shader = load_shader(assets_directory / u8"shaders" / u8"SpriteVertexShader.glsl", GL_VERTEX_SHADER);
+        GLuint fragment_shader = load_shader(assets_directory / u8"shaders" / u8"SpriteFragmentShader.glsl", GL_FRAGMENT_SHADER);
+        sprite_batcher.program = link_shader_program(vertex_shader, fragment_shader);
+
+        glGenVertexArrays(1, &sprite_batcher.vertex_array);
+        glBindVertexArray(sprite_batcher.vertex_array);
+
+        // Every sprite is two triangles over its four vertices; draws start at the sprite's
+        // base vertex, so the same pattern serves all of them
+        std::vector<std::uint32_t> indices;
+        indices.reserve(sprites_per_draw * 6);
+        for (std::uint32_t i = 0; i < sprites_per_draw; i++) {
+            std::uint32_t first = i * 4;
+            indices.insert(indices.end(), {first, first + 1, first + 2, first + 2, first + 3, first});
+        }
+
+        glGenBuffers(1, &sprite_batcher.index_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sprite_batcher.index_buffer);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long) (indices.size() * sizeof(std::uint32_t)), indices.data(), GL_STATIC_DRAW);
+
+        stream_create(sprite_batcher.vertices, sprite_stream_initial_sprites * sprite_size);
+        point_sprite_attributes();
+
+        glBindVertexArray(0);
+        sprite_batcher.last_texture = 0;
+        sprite_batcher.last_assetid = 0;
+    }
+
+    void queue_sprite(const sprite_request &request) {
+        assetid_t assetid = request.assetid;
+        if (assetid != sprite_batcher.last_assetid || sprite_batcher.last_texture == 0) {
+            auto &diffuse_textures = gl_names.assets_dependencies[ASSET_TYPE::DIFFUSE];
+            auto texture = diffuse_textures.find(assetid);
+            // The sprite program only samples 2D textures
+            if (texture == diffuse_textures.end() || gl_names.array_textures.count(texture->second) != 0)
+                return;
+
+            sprite_batcher.last_assetid = assetid;
+            sprite_batcher.last_texture = texture->second;
+            sprite_batcher.last_uv_rect = gl_names.assets_to_uv_rects[ASSET_TYPE::DIFFUSE][assetid];
+        }
+
+        // uv_rect is relative to the asset's image, which may only be part of an atlas page
+        const glm::vec4 &asset_uv_rect = sprite_batcher.last_uv_rect;
+        const glm::vec4 &uv_rect = request.uv_rect;
+        glm::vec4 page_uv_rect(asset_uv_rect.x + uv_rect.x * asset_uv_rect.z,
+                               asset_uv_rect.y + uv_rect.y * asset_uv_rect.w,
+                               uv_rect.z * asset_uv_rect.z,
+                               uv_rect.w * asset_uv_rect.w);
+        sprite_batcher.queued.push_back(queued_sprite{request.position, request.size, request.rotation, page_uv_rect,
+                                                      sprite_batcher.last_texture});
+    }
+
+    void write_sprite_vertices(const queued_sprite &sprite, sprite_vertex *vertices) {
+        float cosine = std::cos(sprite.rotation);
+        float sine = std::sin(sprite.rotation);
+        const float corners[4][2] = {{-0.5f, -0.5f}, {0.5f, -0.5f}, {0.5f, 0.5f}, {-0.5f, 0.5f}};
+
+        for (int i = 0; i < 4; i++) {
+            float x = corners[i][0] * sprite.size.x;
+            float y = corners[i][1] * sprite.size.y;
+
+            vertices[i].x = sprite.position.x + x * cosine - y * sine;
+            vertices[i].y = sprite.position.y + x * sine + y * cosine;
+            vertices[i].z = sprite.position.z;
+            vertices[i].u = sprite.uv_rect.x + (corners[i][0] + 0.5f) * sprite.uv_rect.z;
+            vertices[i].v = sprite.uv_rect.y + (corners[i][1] + 0.5f) * sprite.uv_rect.w;
+        }
+    }
+
+    void flush_sprites() {
+        std::vector<queued_sprite> &queued = sprite_batcher.queued;
+        if (queued.empty())
+            return;
+
+        sprite_batcher.order.clear();
+        for (std::uint32_t i = 0; i < queued.size(); i++) {
+            sprite_batcher.order.push_back(sprite_order{queued[i].texture, i});
+        }
+
+        radix_sort(sprite_batcher.order, sprite_batcher.order_scratch, [](const sprite_order &order) { return order.key; });
+
+        state_use_program(sprite_batcher.program);
+        state_bind_vertex_array(sprite_batcher.vertex_array);
+
+        GLsizeiptr section_size = sprite_batcher.vertices.section_size;
+        stream_reserve(sprite_batcher.vertices, (GLsizeiptr) queued.size() * sprite_size);
+        if (sprite_batcher.vertices.section_size != section_size)
+            point_sprite_attributes();
+
+        std::size_t next = 0;
+        while (next < sprite_batcher.order.size()) {
+            if (stream_space_left(sprite_batcher.vertices) < sprite_size)
+                stream_next_section(sprite_batcher.vertices);
+
+            std::size_t count = std::min({(std::size_t) (stream_space_left(sprite_batcher.vertices) / sprite_size),
+                                          sprite_batcher.order.size() - next,
+                                          sprites_per_draw});
+
+            GLintptr offset = 0;
+            auto *vertices = (sprite_vertex *) stream_map(sprite_batcher.vertices, (GLsizeiptr) count * sprite_size, offset);
+            for (std::size_t i = 0; i < count; i++) {
+                write_sprite_vertices(queued[sprite_batcher.order[next + i].sprite], vertices + i * 4);
+            }
+            stream_unmap(sprite_batcher.vertices);
+
+            auto base_vertex = (GLint) (offset / (GLintptr) sizeof(sprite_vertex));
+            std::size_t run_start = 0;
+            for (std::size_t i = 1; i <= count; i++) {
+                if (i < count && sprite_batcher.order[next + i].key == sprite_batcher.order[next + run_start].key)
+                    continue;
+
+                state_bind_texture(diffuse_texture_unit, GL_TEXTURE_2D, (GLuint) sprite_batcher.order[next + run_start].key);
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei) ((i - run_start) * 6), GL_UNSIGNED_INT, nullptr,
+                                         base_vertex + (GLint) (run_start * 4));
+                render_stats.draw_calls++;
+                run_start = i;
+            }
+
+            next += count;
+        }
+
+        render_stats.sprites = (std::uint32_t) queued.size();
+        queued.clear();
+        stream_end_frame(sprite_batcher.vertices);
+    }
+}
@@ -0,0 +1,81 @@
+
+#include <flatshaper/systems/render/system_render.hpp>
+
+#include <glad/glad.h>
+
+#include <array>
+
+
+namespace flatshaper::systems::render {
+    // Shadow copy of the GL state set through the state_* functions, so redundant calls can be skipped.
+    // Anything that changes the state behind its back (e.g. asset loading) must call state_invalidate.
+    constexpr GLuint unknown_gl_name = UINT32_MAX;
+    constexpr std::size_t cached_texture_units = 8;
+
+    struct {
+        GLuint program = unknown_gl_name;
+        GLuint vertex_array = unknown_gl_name;
+        GLuint array_buffer = unknown_gl_name;
+        GLenum active_texture_unit = GL_NONE;
+        std::array<GLuint, cached_texture_units> textures{};
+    } gl_state;
+
+    void state_invalidate() {
+        gl_state.program = unknown_gl_name;
+        gl_state.vertex_array = unknown_gl_name;
+        gl_state.array_buffer = unknown_gl_name;
+        gl_state.active_texture_unit = GL_NONE;
+        gl_state.textures.fill(unknown_gl_name);
+    }
+
+    void state_use_program(GLuint program) {
+        if (gl_state.program == program) {
+            render_stats.skipped_state_changes++;
+            return;
+        }
+
+        glUseProgram(program);
+        gl_state.program = program;
+        render_stats.program_changes++;
+    }
+
+    void state_bind_vertex_array(GLuint vertex_array) {
+        if (gl_state.vertex_array == vertex_array) {
+            render_stats.skipped_state_changes++;
+            return;
+        }
+
+        glBindVertexArray(vertex_array);
+        gl_state.vertex_array = vertex_array;
+        render_stats.vertex_array_changes++;
+    }
+
+    void state_bind_array_buffer(GLuint buffer) {
+        if (gl_state.array_buffer == buffer) {
+            render_stats.skipped_state_changes++;
+            return;
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        gl_state.array_buffer = buffer;
+    }
+
+    // Texture names are unique across targets, so the cache only needs to remember the name per unit
+    void state_bind_texture(GLuint unit, GLenum target, GLuint texture) {
+        if (unit < cached_texture_units && gl_state.textures[unit] == texture) {
+            render_stats.skipped_state_changes++;
+            return;
+        }
+
+        if (gl_state.active_texture_unit != GL_TEXTURE0 + unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            gl_state.active_texture_unit = GL_TEXTURE0 + unit;
+        }
+
+        glBindTexture(target, texture);
+        if (unit < cached_texture_units)
+            gl_state.textures[unit] = texture;
+
+        render_stats.texture_changes++;
+    }
+}
@@ -0,0 +1,111 @@
+
+#include <flatshaper/systems/render/system_render.hpp>
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+
+namespace flatshaper::systems::render {
+    // Vertex buffer written by the CPU every frame. It is split into sections that are used
+    // round-robin: a section is mapped unsynchronized, and a fence placed after the draws that
+    // read from it keeps the CPU from overwriting it before the GPU is done.
+    constexpr std::size_t stream_buffer_sections = 3;
+
+    struct stream_buffer {
+        GLuint buffer = 0;
+        GLsizeiptr section_size = 0;
+        std::size_t section = 0;
+        GLsizeiptr section_used = 0;
+        std::array<GLsync, stream_buffer_sections> fences{};
+    };
+
+    void stream_create(stream_buffer &stream, GLsizeiptr section_size) {
+        stream.section_size = section_size;
+        glGenBuffers(1, &stream.buffer);
+        state_bind_array_buffer(stream.buffer);
+        glBufferData(GL_ARRAY_BUFFER, section_size * (GLsizeiptr) stream_buffer_sections, nullptr, GL_STREAM_DRAW);
+    }
+
+    void stream_wait_for_section(stream_buffer &stream, std::size_t section) {
+        GLsync &fence = stream.fences[section];
+        if (fence == nullptr)
+            return;
+
+        // Only count the waits that actually block, i.e. where the CPU got a whole ring ahead
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            render_stats.fence_waits++;
+            while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        }
+
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    // Fences the draws issued from the current section and moves on to the next one
+    void stream_next_section(stream_buffer &stream) {
+        stream.fences[stream.section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream.section = (stream.section + 1) % stream_buffer_sections;
+        stream.section_used = 0;
+    }
+
+    GLsizeiptr stream_space_left(const stream_buffer &stream) {
+        return stream.section_size - stream.section_used;
+    }
+
+    // Makes sections hold at least section_size bytes. Growing drains the GPU and reallocates,
+    // so it grows by at least doubling.
+    void stream_reserve(stream_buffer &stream, GLsizeiptr section_size) {
+        if (section_size <= stream.section_size)
+            return;
+
+        for (std::size_t section = 0; section < stream_buffer_sections; section++)
+            stream_wait_for_section(stream, section);
+
+        glDeleteBuffers(1, &stream.buffer);
+        // Deleting a bound buffer unbinds it, and the new buffer may get the same name back
+        if (gl_state.array_buffer == stream.buffer)
+            gl_state.array_buffer = 0;
+        stream_create(stream, std::max(section_size, stream.section_size * 2));
+        stream.section = 0;
+        stream.section_used = 0;
+    }
+
+    // Maps size bytes of the current section for writing, offset receives their position in the buffer
+    void *stream_map(stream_buffer &stream, GLsizeiptr size, GLintptr &offset) {
+        if (size > stream.section_size)
+            throw std::runtime_error(u8"Streamed data larger than a stream buffer section");
+
+        if (size > stream_space_left(stream))
+            stream_next_section(stream);
+
+        // The first write into a section waits for the GPU to be done with its previous contents
+        if (stream.section_used == 0)
+            stream_wait_for_section(stream, stream.section);
+
+        offset = ((GLintptr) stream.section) * stream.section_size + stream.section_used;
+        stream.section_used += size;
+
+        state_bind_array_buffer(stream.buffer);
+        void *data = glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+                                      GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (data == nullptr)
+            throw std::runtime_error(u8"Cannot map stream buffer");
+
+        return data;
+    }
+
+    void stream_unmap(stream_buffer &stream) {
+        state_bind_array_buffer(stream.buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    // Every frame starts in a fresh section, so the GPU can still read the previous frames' data
+    void stream_end_frame(stream_buffer &stream) {
+        if (stream.section_used > 0)
+            stream_next_section(stream);
+    }
+}
@@ -0,0 +1,243 @@
+
+#include <flatshaper/systems/render/system_render.hpp>
+
+#include <glad/glad.h>
+#include <glm/ext.hpp>
+
+#include <array>
+#include <unordered_map>
+#include <vector>
+
+
+namespace flatshaper::systems::render {
+    // Static level geometry as a grid of tiles in the xy plane. Tiles are baked per 32x32 chunk into
+    // one mesh per material, which is rebuilt only when one of the chunk's tiles changes and is
+    // then drawn like a batch with a single instance (see sync_tile_mesh).
+    constexpr std::int32_t tilemap_chunk_tiles = 32;
+    constexpr std::size_t tilemap_quads_per_chunk = tilemap_chunk_tiles * tilemap_chunk_tiles;
+    constexpr std::uint32_t no_render_batch = UINT32_MAX;
+
+    // Everything tiles in one mesh have in common. Vertices only carry the tile's 0 to 1 UVs, the
+    // atlas rectangles and layers are applied by the vertex shader like for any other instance.
+    struct tile_material {
+        GLuint shader_program;
+        GLenum texture_target;
+        GLuint diffuse_texture;
+        GLuint normal_texture;
+        glm::vec4 uv_diffuse;
+        glm::vec4 uv_normal;
+        glm::vec2 texture_layers;
+
+        bool operator==(const tile_material &other) const {
+            return shader_program == other.shader_program && texture_target == other.texture_target &&
+                   diffuse_texture == other.diffuse_texture && normal_texture == other.normal_texture &&
+                   uv_diffuse == other.uv_diffuse && uv_normal == other.uv_normal &&
+                   texture_layers == other.texture_layers;
+        }
+    };
+
+    struct tile_mesh {
+        tile_material material;
+        GLuint vertex_array;
+        GLuint vertex_buffer;
+        GLsizei quad_count;
+        world_bounds bounds;
+        // The render batch drawing this mesh, or no_render_batch
+        std::uint32_t batch;
+    };
+
+    struct tilemap_chunk {
+        // Row-major, 0 is no tile
+        std::array<assetid_t, tilemap_quads_per_chunk> tiles{};
+        bool dirty = false;
+        std::vector<tile_mesh> meshes;
+    };
+
+    struct {
+        std::unordered_map<std::uint64_t, tilemap_chunk> chunks;
+        std::vector<std::uint64_t> dirty_chunks;
+        float tile_size = 1.0f;
+        float depth = 0.0f;
+        std::uint8_t layer = 0;
+        // Two triangles per quad, shared by the vertex arrays of all meshes
+        GLuint index_buffer = 0;
+
+        // Reused between rebuilds
+        std::vector<tile_material> group_materials;
+        std::vector<std::vector<float>> group_vertices;
+    } tilemap;
+
+    // Floor division, so that negative tiles land in the chunk to their left/below
+    std::int32_t tilemap_chunk_coordinate(std::int32_t tile) {
+        return tile >= 0 ? tile / tilemap_chunk_tiles : -((-tile - 1) / tilemap_chunk_tiles) - 1;
+    }
+
+    std::uint64_t tilemap_chunk_key(std::int32_t x, std::int32_t y) {
+        return (((std::uint64_t) (std::uint32_t) x) << 32) | (std::uint32_t) y;
+    }
+
+    void tilemap_mark_dirty(std::uint64_t chunk_key, tilemap_chunk &chunk) {
+        if (!chunk.dirty) {
+            chunk.dirty = true;
+            tilemap.dirty_chunks.push_back(chunk_key);
+        }
+    }
+
+    void tilemap_set_tile(std::int32_t x, std::int32_t y, assetid_t assetid) {
+        std::int32_t chunk_x = tilemap_chunk_coordinate(x);
+        std::int32_t chunk_y = tilemap_chunk_coordinate(y);
+        std::uint64_t chunk_key = tilemap_chunk_key(chunk_x, chunk_y);
+
+        tilemap_chunk &chunk = tilemap.chunks[chunk_key];
+        assetid_t &tile = chunk.tiles[(y - chunk_y * tilemap_chunk_tiles) * tilemap_chunk_tiles + (x - chunk_x * tilemap_chunk_tiles)];
+        if (tile == assetid)
+            return;
+
+        tile = assetid;
+        tilemap_mark_dirty(chunk_key, chunk);
+    }
+
+    void tilemap_configure(float tile_size, float depth, std::uint8_t layer) {
+        tilemap.tile_size = tile_size;
+        tilemap.depth = depth;
+        tilemap.layer = layer;
+        for (auto &chunk: tilemap.chunks)
+            tilemap_mark_dirty(chunk.first, chunk.second);
+    }
+
+    tile_material make_tile_material(assetid_t assetid) {
+        GLuint diffuse_texture = gl_names.assets_dependencies[ASSET_TYPE::DIFFUSE][assetid];
+        return tile_material{gl_names.assets_to_shader_programs[assetid],
+                             (GLenum) (gl_names.array_textures.count(diffuse_texture) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D),
+                             diffuse_texture,
+                             gl_names.assets_dependencies[ASSET_TYPE::NORMAL][assetid],
+                             gl_names.assets_to_uv_rects[ASSET_TYPE::DIFFUSE][assetid],
+                             gl_names.assets_to_uv_rects[ASSET_TYPE::NORMAL][assetid],
+                             glm::vec2(gl_names.assets_to_texture_layers[ASSET_TYPE::DIFFUSE][assetid],
+                                       gl_names.assets_to_texture_layers[ASSET_TYPE::NORMAL][assetid])};
+    }
+
+    tile_mesh create_tile_mesh(const tile_material &material) {
+        // The element array binding is part of the vertex array, so ours has to be bound before the
+        // index buffer is, or it would replace the index buffer of whichever vertex array was bound
+        tile_mesh mesh{material, 0, 0, 0, world_bounds{}, no_render_batch};
+        glGenVertexArrays(1, &mesh.vertex_array);
+        glBindVertexArray(mesh.vertex_array);
+
+        if (tilemap.index_buffer == 0) {
+            std::vector<std::uint32_t> indices;
+            indices.reserve(tilemap_quads_per_chunk * 6);
+            for (std::uint32_t i = 0; i < tilemap_quads_per_chunk; i++) {
+                std::uint32_t first = i * 4;
+                indices.insert(indices.end(), {first, first + 1, first + 2, first + 2, first + 3, first});
+            }
+
+            glGenBuffers(1, &tilemap.index_buffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tilemap.index_buffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, (long) (indices.size() * sizeof(std::uint32_t)), indices.data(), GL_STATIC_DRAW);
+        }
+
+        glGenBuffers(1, &mesh.vertex_buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tilemap.index_buffer);
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), nullptr);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void *) (3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        glBindVertexArray(0);
+        return mesh;
+    }
+
+    void rebuild_chunk(std::uint64_t chunk_key, tilemap_chunk &chunk) {
+        auto chunk_x = (std::int32_t) (std::uint32_t) (chunk_key >> 32);
+        auto chunk_y = (std::int32_t) (std::uint32_t) chunk_key;
+
+        // Group the tiles' quads by material
+        tilemap.group_materials.clear();
+        for (std::vector<float> &vertices: tilemap.group_vertices)
+            vertices.clear();
+
+        for (std::int32_t y = 0; y < tilemap_chunk_tiles; y++) {
+            for (std::int32_t x = 0; x < tilemap_chunk_tiles; x++) {
+                assetid_t assetid = chunk.tiles[y * tilemap_chunk_tiles + x];
+                if (assetid == 0)
+                    continue;
+
+                tile_material material = make_tile_material(assetid);
+                std::size_t group = 0;
+                while (group < tilemap.group_materials.size() && !(tilemap.group_materials[group] == material))
+                    group++;
+
+                if (group == tilemap.group_materials.size()) {
+                    tilemap.group_materials.push_back(material);
+                    if (tilemap.group_vertices.size() < tilemap.group_materials.size())
+                        tilemap.group_vertices.emplace_back();
+                }
+
+                float left = (float) (chunk_x * tilemap_chunk_tiles + x) * tilemap.tile_size;
+                float bottom = (float) (chunk_y * tilemap_chunk_tiles + y) * tilemap.tile_size;
+                const float corners[4][2] = {{0.0f, 0.0f}, {1.0f, 0.0f}, {1.0f, 1.0f}, {0.0f, 1.0f}};
+
+                std::vector<float> &vertices = tilemap.group_vertices[group];
+                for (const auto &corner: corners) {
+                    vertices.insert(vertices.end(), {left + corner[0] * tilemap.tile_size,
+                                                     bottom + corner[1] * tilemap.tile_size,
+                                                     tilemap.depth,
+                                                     corner[0], corner[1]});
+                }
+            }
+        }
+
+        // Meshes keep their vertex array (and render batch) when their material goes away, so a
+        // tile coming back later reuses them
+        for (tile_mesh &mesh: chunk.meshes)
+            mesh.quad_count = 0;
+
+        for (std::size_t group = 0; group < tilemap.group_materials.size(); group++) {
+            std::size_t mesh_index = 0;
+            while (mesh_index < chunk.meshes.size() && !(chunk.meshes[mesh_index].material == tilemap.group_materials[group]))
+                mesh_index++;
+
+            if (mesh_index == chunk.meshes.size())
+                chunk.meshes.push_back(create_tile_mesh(tilemap.group_materials[group]));
+
+            tile_mesh &mesh = chunk.meshes[mesh_index];
+            const std::vector<float> &vertices = tilemap.group_vertices[group];
+            mesh.quad_count = (GLsizei) (vertices.size() / 20);
+
+            glBindBuffer(GL_ARRAY_BUFFER, mesh.vertex_buffer);
+            glBufferData(GL_ARRAY_BUFFER, (long) (vertices.size() * sizeof(float)), vertices.data(), GL_STATIC_DRAW);
+
+            glm::vec3 min(vertices[0], vertices[1], vertices[2]);
+            glm::vec3 max = min;
+            for (std::size_t i = 5; i < vertices.size(); i += 5) {
+                min = glm::min(min, glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+                max = glm::max(max, glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+            }
+            mesh.bounds = world_bounds{(min + max) * 0.5f, (max - min) * 0.5f};
+        }
+    }
+
+    // Rebuilds the chunks whose tiles changed and calls on_mesh_changed(tile_mesh &) for each of
+    // their meshes
+    template<typename Function>
+    void tilemap_rebuild(Function on_mesh_changed) {
+        if (tilemap.dirty_chunks.empty())
+            return;
+
+        for (std::uint64_t chunk_key: tilemap.dirty_chunks) {
+            tilemap_chunk &chunk = tilemap.chunks[chunk_key];
+            chunk.dirty = false;
+            rebuild_chunk(chunk_key, chunk);
+
+            for (tile_mesh &mesh: chunk.meshes)
+                on_mesh_changed(mesh);
+        }
+
+        tilemap.dirty_chunks.clear();
+        // Buffers and vertex arrays were bound behind the state cache's back
+        state_invalidate();
+    }
+}
@@ -17,11 +17,23 @@
 
 #include <flatshaper/systems/render/system_render.hpp>
 #include <flatshaper/systems/system_physics.hpp>
+#include <flatshaper/component_store.hpp>
+#include <flatshaper/radix_sort.hpp>
+#include <flatshaper/triple_buffer.hpp>
+#include <flatshaper/thread_pool.hpp>
+#include "render_state.cpp"
+#include "render_stream.cpp"
 #include "render_assets.cpp"
+#include "render_culling.cpp"
+#include "render_sprites.cpp"
+#include "render_tilemap.cpp"
 
 #include <glad/glad.h>
 #include <glm/ext.hpp>
 
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -32,79 +44,592 @@ namespace flatshaper::systems::render {
     float render_screen_width{};
     float render_screen_height{};
     float render_fov{};
+    float render_time{};
+    render_statistics render_stats{};
 
-    std::unordered_map<entityid_t, assetid_t> rendered_entities;
+    // Everything a draw binds. Assets that only differ in their part of an atlas page share one.
+    struct render_material {
+        GLuint vertex_array;
+        // Index range of the model in the vertex array, see geometry_arena
+        model_range model;
+        GLuint shader_program;
+        // GL_TEXTURE_2D_ARRAY for programs sampling texture arrays, the layer is part of the instance
+        GLenum texture_target;
+        GLuint diffuse_texture;
+        GLuint normal_texture;
 
-    glm::mat4 view_matrix = glm::identity<glm::mat4>();
-    glm::mat4 projection_matrix = glm::identity<glm::mat4>();
+        bool operator==(const render_material &other) const {
+            return vertex_array == other.vertex_array && model.model == other.model.model &&
+                   shader_program == other.shader_program &&
+                   texture_target == other.texture_target &&
+                   diffuse_texture == other.diffuse_texture && normal_texture == other.normal_texture;
+        }
+    };
+
+    // Must match the per-instance attributes of the vertex shaders
+    struct render_instance {
+        glm::mat4 model;
+        glm::vec4 uv_diffuse;
+        glm::vec4 uv_normal;
+        // Diffuse and normal texture array layers
+        glm::vec2 layers;
+    };
+
+    // Persistent render queue: one batch per material and layer (static and dynamic entities
+    // separately) with contiguous per-instance arrays, maintained by render_add_entity/
+    // render_remove_entity and transform change ticks. The visible instances are packed into one
+    // range of the mapped instance stream per batch every frame.
+    struct render_batch {
+        render_material material;
+        model_bounds local_bounds;
+        bool is_static;
+        std::uint8_t layer;
+        std::vector<entityid_t> entities;
+        std::vector<render_instance> instances;
+        std::vector<world_bounds> bounds;
+        // Range in this frame's instance stream section, in instances from instance_stream_offset
+        std::size_t first_visible_instance;
+        std::size_t visible_count;
+    };
+
+    constexpr std::uint32_t unplaced_instance = UINT32_MAX;
+
+    struct render_slot {
+        assetid_t assetid;
+        std::uint32_t batch;
+        // Position in the batch, or unplaced_instance while the entity has no world matrix yet
+        std::uint32_t instance;
+        // Static entities only: where the entity is filed in the static grid
+        std::uint64_t cell_key;
+        std::uint32_t cell_index;
+    };
+
+    // Everything the render thread reads from the simulation, copied once per simulation tick.
+    // Matrices keep their change ticks, so the render thread finds what changed since the
+    // snapshot it synced last, even if it skipped snapshots in between.
+    struct render_snapshot {
+        glm::vec3 camera_position;
+        glm::vec3 camera_direction;
+        float screen_width;
+        float screen_height;
+        float fov;
+        float time;
+        component_store<glm::mat4> matrices;
+        // Closed change tick, every matrix write in the snapshot is stamped with it or earlier
+        std::uint32_t tick;
+        std::vector<sprite_request> sprites;
+    };
+
+    triple_buffer<render_snapshot> render_snapshots;
+    bool render_has_snapshot = false;
+
+    // Structural changes must not be skipped like snapshots, so they are queued instead
+    enum class render_edit_type : std::uint8_t {
+        ADD_ENTITY,
+        REMOVE_ENTITY,
+        SET_LAYER,
+        SET_TILE,
+        CONFIGURE_TILEMAP
+    };
+
+    struct render_edit {
+        render_edit_type type;
+        entityid_t entityid;
+        assetid_t assetid;
+        bool is_static;
+        std::uint8_t layer;
+        // SET_TILE only
+        std::int32_t tile_x;
+        std::int32_t tile_y;
+        // CONFIGURE_TILEMAP only
+        float tile_size;
+        float tile_depth;
+    };
+
+    std::mutex render_edits_mutex;
+    std::vector<render_edit> pending_render_edits;
+    // Only touched by the render thread, swapped with pending_render_edits to keep the lock short
+    std::vector<render_edit> applied_render_edits;
+
+    // Everything below is owned by the render thread
+    std::vector<render_batch> render_batches;
+    // Keyed by asset ID << 1 | is_static, several assets can map to the same batch
+    std::unordered_map<std::uint64_t, std::uint32_t> assets_to_render_batches;
+    std::unordered_map<assetid_t, std::uint8_t> assets_to_layers;
+    component_store<render_slot> rendered_entities;
+    // Last change tick whose matrix writes have been copied into the batches
+    std::uint32_t render_synced_tick = 0;
+
+    // One draw, ordered by a packed key (most significant first):
+    // layer (8 bits), shader program (12), diffuse texture (12), normal texture (12), model (12), depth (8).
+    // Names are truncated to their field, which only affects grouping, never which state is bound.
+    // All models share the geometry arena's vertex array, so grouping by model only keeps draws of
+    // the same index range together.
+    struct render_command {
+        std::uint64_t key;
+        std::uint32_t batch;
+    };
+
+    std::vector<render_command> render_commands;
+    std::vector<render_command> render_commands_scratch;
+
+    // Render preparation runs as jobs on the worker pool, each culling a range of instances into
+    // its own list of per-instance commands. Merging them, sorting the draws and all GL calls stay
+    // on the render thread.
+    struct instance_command {
+        std::uint32_t batch;
+        std::uint32_t instance;
+    };
 
-    void render_add_entity(entityid_t entity, assetid_t assetid) {
-        if (is_entity_valid(entity)) {
-            rendered_entities[entity] = assetid;
+    constexpr std::uint32_t static_candidates_job = UINT32_MAX;
+    constexpr std::uint32_t render_job_grain = 4096;
+
+    struct render_job {
+        // Or static_candidates_job for a range of static_candidates
+        std::uint32_t batch;
+        std::uint32_t begin;
+        std::uint32_t end;
+    };
+
+    std::vector<render_job> render_jobs;
+    std::vector<std::vector<instance_command>> render_job_commands;
+    // Static instances in the grid cells overlapping the frustum
+    std::vector<instance_command> static_candidates;
+    std::vector<instance_command> instance_commands;
+    std::vector<instance_command> instance_commands_scratch;
+
+    std::uint64_t make_sort_key(std::uint8_t layer, GLuint shader_program, GLuint diffuse_texture,
+                                GLuint normal_texture, std::uint32_t model, std::uint8_t depth) {
+        return (((std::uint64_t) layer) << 56) |
+               (((std::uint64_t) (shader_program & 0xFFFu)) << 44) |
+               (((std::uint64_t) (diffuse_texture & 0xFFFu)) << 32) |
+               (((std::uint64_t) (normal_texture & 0xFFFu)) << 20) |
+               (((std::uint64_t) (model & 0xFFFu)) << 8) |
+               depth;
+    }
+
+    // Must match the iv_model/iv_uv_diffuse/iv_uv_normal/iv_layers locations in the vertex shaders
+    constexpr GLuint instance_model_matrix_attribute_location = 4;
+    constexpr GLuint instance_uv_diffuse_attribute_location = 8;
+    constexpr GLuint instance_uv_normal_attribute_location = 9;
+    constexpr GLuint instance_layers_attribute_location = 10;
+
+    constexpr float camera_near_plane = 0.1f;
+    constexpr float camera_far_plane = 10.1f;
+
+    camera_uniforms camera{};
+
+    std::uint32_t find_or_create_batch(assetid_t assetid, bool is_static) {
+        std::uint64_t batch_key = (((std::uint64_t) assetid) << 1) | (is_static ? 1u : 0u);
+        auto batch = assets_to_render_batches.find(batch_key);
+        if (batch != assets_to_render_batches.end())
+            return batch->second;
+
+        GLuint diffuse_texture = gl_names.assets_dependencies[ASSET_TYPE::DIFFUSE][assetid];
+        render_material material{gl_names.assets_dependencies[ASSET_TYPE::MODEL][assetid],
+                                 gl_names.assets_to_model_ranges[assetid],
+                                 gl_names.assets_to_shader_programs[assetid],
+                                 (GLenum) (gl_names.array_textures.count(diffuse_texture) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D),
+                                 diffuse_texture,
+                                 gl_names.assets_dependencies[ASSET_TYPE::NORMAL][assetid]};
+        std::uint8_t layer = assets_to_layers[assetid];
+
+        // Only runs once per asset, so a linear search over the batches is fine
+        std::uint32_t index = 0;
+        while (index < render_batches.size() &&
+               !(render_batches[index].material == material && render_batches[index].layer == layer &&
+                 render_batches[index].is_static == is_static))
+            index++;
+
+        if (index == render_batches.size()) {
+            // The vertex array identifies the model, so all assets of the batch share its bounds
+            auto bounds = gl_names.assets_to_bounds.find(assetid);
+            render_batches.push_back(render_batch{material,
+                                                  bounds == gl_names.assets_to_bounds.end() ? model_bounds{} : bounds->second,
+                                                  is_static, layer, {}, {}, {}, 0, 0});
         }
+
+        assets_to_render_batches[batch_key] = index;
+        return index;
     }
 
-    void render_remove_entity(entityid_t entityid) {
+    world_bounds entity_bounds(const render_batch &batch, const glm::mat4 &matrix) {
+        return transform_bounds(batch.local_bounds, matrix);
+    }
+
+    void place_instance(entityid_t entityid, render_slot &slot, const glm::mat4 &matrix) {
+        render_batch &batch = render_batches[slot.batch];
+        slot.instance = (std::uint32_t) batch.entities.size();
+        batch.entities.push_back(entityid);
+        batch.instances.push_back(render_instance{matrix,
+                                                  gl_names.assets_to_uv_rects[ASSET_TYPE::DIFFUSE][slot.assetid],
+                                                  gl_names.assets_to_uv_rects[ASSET_TYPE::NORMAL][slot.assetid],
+                                                  glm::vec2(gl_names.assets_to_texture_layers[ASSET_TYPE::DIFFUSE][slot.assetid],
+                                                            gl_names.assets_to_texture_layers[ASSET_TYPE::NORMAL][slot.assetid])});
+        batch.bounds.push_back(entity_bounds(batch, matrix));
+
+        if (batch.is_static)
+            static_grid_insert(entityid, batch.bounds.back(), slot.cell_key, slot.cell_index);
+    }
+
+    void unfile_static_instance(const render_slot &slot) {
+        entityid_t moved_entity = static_grid_remove(slot.cell_key, slot.cell_index);
+        if (moved_entity != null_entity)
+            rendered_entities.find(moved_entity)->cell_index = slot.cell_index;
+    }
+
+    void update_instance(entityid_t entityid, render_slot &slot, const glm::mat4 &matrix) {
+        render_batch &batch = render_batches[slot.batch];
+        batch.instances[slot.instance].model = matrix;
+        batch.bounds[slot.instance] = entity_bounds(batch, matrix);
+
+        if (batch.is_static) {
+            unfile_static_instance(slot);
+            static_grid_insert(entityid, batch.bounds[slot.instance], slot.cell_key, slot.cell_index);
+        }
+    }
+
+    void apply_remove_entity(entityid_t entityid);
+
+    void apply_add_entity(entityid_t entity, assetid_t assetid, bool is_static) {
+        // Either the entity itself or a stale handle of its slot, deleted without render_remove_entity.
+        // insert() would evict the latter without unfiling it from its batch and the static grid.
+        entityid_t previous = rendered_entities.entity_with_index(entity_index(entity));
+        if (previous != null_entity)
+            apply_remove_entity(previous);
+
+        render_slot slot{assetid, find_or_create_batch(assetid, is_static), unplaced_instance, 0, 0};
+        const glm::mat4 *matrix = render_snapshots.read_buffer().matrices.find(entity);
+        if (matrix != nullptr)
+            place_instance(entity, slot, *matrix);
+
+        rendered_entities.insert(entity, slot);
+    }
+
+    void apply_set_layer(assetid_t assetid, std::uint8_t layer) {
+        assets_to_layers[assetid] = layer;
+
+        // Batches are shared with other assets, so the asset's entities move to another batch
+        assets_to_render_batches.erase(((std::uint64_t) assetid) << 1);
+        assets_to_render_batches.erase((((std::uint64_t) assetid) << 1) | 1u);
+
+        std::vector<std::pair<entityid_t, bool>> moved_entities;
+        for (std::size_t i = 0; i < rendered_entities.size(); i++) {
+            const render_slot &slot = rendered_entities.component_at(i);
+            if (slot.assetid == assetid)
+                moved_entities.emplace_back(rendered_entities.entity_at(i), render_batches[slot.batch].is_static);
+        }
+
+        for (const auto &moved_entity: moved_entities)
+            apply_add_entity(moved_entity.first, assetid, moved_entity.second);
+    }
+
+    void apply_remove_entity(entityid_t entityid) {
+        const render_slot *slot = rendered_entities.find(entityid);
+        if (slot == nullptr)
+            return;
+
+        if (slot->instance != unplaced_instance) {
+            render_batch &batch = render_batches[slot->batch];
+            if (batch.is_static)
+                unfile_static_instance(*slot);
+
+            // Swap the batch's last instance into the hole
+            entityid_t moved_entity = batch.entities.back();
+            batch.entities[slot->instance] = moved_entity;
+            batch.instances[slot->instance] = batch.instances.back();
+            batch.bounds[slot->instance] = batch.bounds.back();
+            batch.entities.pop_back();
+            batch.instances.pop_back();
+            batch.bounds.pop_back();
+
+            if (moved_entity != entityid)
+                rendered_entities.find(moved_entity)->instance = slot->instance;
+        }
+
         rendered_entities.erase(entityid);
     }
 
+    // Tile meshes are drawn by a batch of their own with a single instance at the origin, so culling,
+    // sorting and drawing treat them like any other batch. Its one bounding box is the chunk's.
+    void sync_tile_mesh(tile_mesh &mesh) {
+        if (mesh.batch == no_render_batch) {
+            render_material material{mesh.vertex_array, model_range{0, 0, 0, 0}, mesh.material.shader_program,
+                                     mesh.material.texture_target, mesh.material.diffuse_texture, mesh.material.normal_texture};
+            mesh.batch = (std::uint32_t) render_batches.size();
+            render_batches.push_back(render_batch{material, model_bounds{}, false, 0, {}, {}, {}, 0, 0});
+        }
+
+        render_batch &batch = render_batches[mesh.batch];
+        batch.layer = tilemap.layer;
+        batch.material.model.element_count = mesh.quad_count * 6;
+        batch.entities.clear();
+        batch.instances.clear();
+        batch.bounds.clear();
+
+        if (mesh.quad_count > 0) {
+            batch.entities.push_back(null_entity);
+            batch.instances.push_back(render_instance{glm::mat4(1.0f), mesh.material.uv_diffuse, mesh.material.uv_normal,
+                                                      mesh.material.texture_layers});
+            batch.bounds.push_back(mesh.bounds);
+        }
+    }
+
+    void push_render_edit(const render_edit &edit) {
+        std::lock_guard<std::mutex> lock(render_edits_mutex);
+        pending_render_edits.push_back(edit);
+    }
+
+    void render_add_entity(entityid_t entity, assetid_t assetid, bool is_static) {
+        if (!is_entity_valid(entity))
+            return;
+
+        push_render_edit(render_edit{render_edit_type::ADD_ENTITY, entity, assetid, is_static, 0, 0, 0, 0.0f, 0.0f});
+    }
+
+    void render_set_layer(assetid_t assetid, std::uint8_t layer) {
+        push_render_edit(render_edit{render_edit_type::SET_LAYER, null_entity, assetid, false, layer, 0, 0, 0.0f, 0.0f});
+    }
+
+    void render_remove_entity(entityid_t entityid) {
+        push_render_edit(render_edit{render_edit_type::REMOVE_ENTITY, entityid, 0, false, 0, 0, 0, 0.0f, 0.0f});
+    }
+
+    void render_set_tile(std::int32_t x, std::int32_t y, assetid_t assetid) {
+        push_render_edit(render_edit{render_edit_type::SET_TILE, null_entity, assetid, true, 0, x, y, 0.0f, 0.0f});
+    }
+
+    void render_configure_tilemap(float tile_size, float depth, std::uint8_t layer) {
+        push_render_edit(render_edit{render_edit_type::CONFIGURE_TILEMAP, null_entity, 0, true, layer, 0, 0, tile_size, depth});
+    }
+
+    void render_draw_sprite(assetid_t assetid, glm::vec3 position, glm::vec2 size, float rotation, glm::vec4 uv_rect) {
+        render_snapshots.write_buffer().sprites.push_back(sprite_request{assetid, position, size, rotation, uv_rect});
+    }
+
+    void render_submit_frame() {
+        render_snapshot &snapshot = render_snapshots.write_buffer();
+        snapshot.camera_position = render_camera_position;
+        snapshot.camera_direction = render_camera_direction;
+        snapshot.screen_width = render_screen_width;
+        snapshot.screen_height = render_screen_height;
+        snapshot.fov = render_fov;
+        snapshot.time = render_time;
+        // The buffer still holds the matrices as of its own last tick, so unless entities were added
+        // or removed since, only the matrices written after that tick are copied
+        snapshot.matrices.copy_changed_since(physics_matrix, snapshot.tick);
+        snapshot.tick = advance_change_tick();
+
+        render_snapshots.publish();
+        // The buffer we got back was either consumed or skipped, its sprites are stale either way
+        render_snapshots.write_buffer().sprites.clear();
+    }
+
+    void apply_render_edits() {
+        {
+            std::lock_guard<std::mutex> lock(render_edits_mutex);
+            std::swap(pending_render_edits, applied_render_edits);
+        }
+
+        for (const render_edit &edit: applied_render_edits) {
+            switch (edit.type) {
+                case render_edit_type::ADD_ENTITY:
+                    apply_add_entity(edit.entityid, edit.assetid, edit.is_static);
+                    break;
+                case render_edit_type::REMOVE_ENTITY:
+                    apply_remove_entity(edit.entityid);
+                    break;
+                case render_edit_type::SET_LAYER:
+                    apply_set_layer(edit.assetid, edit.layer);
+                    break;
+                case render_edit_type::SET_TILE:
+                    tilemap_set_tile(edit.tile_x, edit.tile_y, edit.assetid);
+                    break;
+                case render_edit_type::CONFIGURE_TILEMAP:
+                    tilemap_configure(edit.tile_size, edit.tile_depth, edit.layer);
+                    break;
+            }
+        }
+
+        applied_render_edits.clear();
+    }
+
     void render_draw() {
+        render_stats = render_statistics{};
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glEnable(GL_DEPTH_TEST);
 
-        projection_matrix = glm::perspective(render_fov, render_screen_width / render_screen_height, 0.1f, 10.1f);
-        view_matrix = glm::lookAt(render_camera_position, render_camera_position + render_camera_direction, glm::vec3(0.0f, 1.0f, 0.0f));
+        // Without a new snapshot the last one is drawn again
+        render_has_snapshot = render_snapshots.acquire() || render_has_snapshot;
+        if (!render_has_snapshot)
+            return;
 
-        std::unordered_map<assetid_t, std::vector<glm::mat4x4>> assets_to_matrices;
+        render_snapshot &snapshot = render_snapshots.read_buffer();
+        apply_render_edits();
+        tilemap_rebuild(sync_tile_mesh);
 
-        for (const auto &rendered_entity: rendered_entities) {
-            if (assets_to_matrices.find(rendered_entity.second) == assets_to_matrices.end()) {
-                assets_to_matrices[rendered_entity.second] = std::vector<glm::mat4x4>{};
-            }
+        camera.projection = glm::perspective(snapshot.fov, snapshot.screen_width / snapshot.screen_height, camera_near_plane, camera_far_plane);
+        camera.view = glm::lookAt(snapshot.camera_position, snapshot.camera_position + snapshot.camera_direction, glm::vec3(0.0f, 1.0f, 0.0f));
+        camera.view_projection = camera.projection * camera.view;
+        camera.time = snapshot.time;
+
+        // The buffer stays bound to camera_uniform_block_binding, every program reads from it
+        glBindBuffer(GL_UNIFORM_BUFFER, gl_names.camera_uniform_buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(camera_uniforms), &camera);
+
+        // Only copy the world matrices that changed since the last synced snapshot
+        std::uint32_t since = render_synced_tick;
+        render_synced_tick = snapshot.tick;
+        snapshot.matrices.each_changed_since(since, [](entityid_t entityid, const glm::mat4 &matrix) {
+            render_slot *slot = rendered_entities.find(entityid);
+            if (slot == nullptr)
+                return;
+
+            if (slot->instance == unplaced_instance)
+                place_instance(entityid, *slot, matrix);
+            else
+                update_instance(entityid, *slot, matrix);
+        });
+
+        // Cull in jobs: dynamic batches are split into ranges of instances, static entities are first
+        // looked up in the grid and the candidates split up the same way
+        view_frustum frustum = make_view_frustum(camera.view_projection);
+
+        static_candidates.clear();
+        static_grid_query(frustum.min, frustum.max, [](entityid_t entityid) {
+            const render_slot &slot = *rendered_entities.find(entityid);
+            static_candidates.push_back(instance_command{slot.batch, slot.instance});
+        });
+
+        render_jobs.clear();
+        for (std::uint32_t i = 0; i < render_batches.size(); i++) {
+            auto instance_count = (std::uint32_t) render_batches[i].instances.size();
+            for (std::uint32_t begin = 0; begin < instance_count && !render_batches[i].is_static; begin += render_job_grain)
+                render_jobs.push_back(render_job{i, begin, std::min(instance_count, begin + render_job_grain)});
+        }
 
-            auto position = physics_matrix.find(rendered_entity.first);
-            if (position == physics_matrix.end()) {
-                rendered_entities.erase(rendered_entity.first);
-                continue;
+        auto candidate_count = (std::uint32_t) static_candidates.size();
+        for (std::uint32_t begin = 0; begin < candidate_count; begin += render_job_grain)
+            render_jobs.push_back(render_job{static_candidates_job, begin, std::min(candidate_count, begin + render_job_grain)});
+
+        if (render_job_commands.size() < render_jobs.size())
+            render_job_commands.resize(render_jobs.size());
+
+        worker_pool().run(render_jobs.size(), [&frustum](std::size_t index) {
+            const render_job &job = render_jobs[index];
+            std::vector<instance_command> &commands = render_job_commands[index];
+            commands.clear();
+
+            if (job.batch == static_candidates_job) {
+                for (std::uint32_t i = job.begin; i < job.end; i++) {
+                    const instance_command &candidate = static_candidates[i];
+                    if (is_visible(frustum, render_batches[candidate.batch].bounds[candidate.instance]))
+                        commands.push_back(candidate);
+                }
+            } else {
+                const render_batch &batch = render_batches[job.batch];
+                for (std::uint32_t i = job.begin; i < job.end; i++) {
+                    if (is_visible(frustum, batch.bounds[i]))
+                        commands.push_back(instance_command{job.batch, i});
+                }
             }
+        });
+
+        // Merge: grouping the commands of all jobs by batch gives every batch one contiguous range
+        instance_commands.clear();
+        for (std::size_t i = 0; i < render_jobs.size(); i++)
+            instance_commands.insert(instance_commands.end(), render_job_commands[i].begin(), render_job_commands[i].end());
+
+        radix_sort(instance_commands, instance_commands_scratch, [](const instance_command &command) { return command.batch; });
+
+        render_stats.visible_instances = (std::uint32_t) instance_commands.size();
+
+        render_commands.clear();
+        for (std::size_t first = 0; first < instance_commands.size();) {
+            std::uint32_t batch_index = instance_commands[first].batch;
+            std::size_t end = first;
+            while (end < instance_commands.size() && instance_commands[end].batch == batch_index)
+                end++;
 
-            std::vector<glm::mat4x4> &positions = assets_to_matrices[rendered_entity.second];
-            positions.push_back(position->second);
+            render_batch &batch = render_batches[batch_index];
+            batch.first_visible_instance = first;
+            batch.visible_count = end - first;
+
+            std::uint64_t key = make_sort_key(batch.layer,
+                                              batch.material.shader_program,
+                                              batch.material.diffuse_texture,
+                                              batch.material.normal_texture,
+                                              batch.material.model.model,
+                                              0);
+            render_commands.push_back(render_command{key, batch_index});
+            first = end;
         }
 
-        for (const auto &asset_to_matrix: assets_to_matrices) {
-            GLuint model = gl_names.assets_dependencies[ASSET_TYPE::MODEL][asset_to_matrix.first];
-            GLuint shader_program = gl_names.assets_to_shader_programs[asset_to_matrix.first];
-            int32_t element_count = gl_names.assets_to_element_counts[asset_to_matrix.first];
-            GLuint diffuse_texture = gl_names.assets_dependencies[ASSET_TYPE::DIFFUSE][asset_to_matrix.first];
-            GLuint normal_texture = gl_names.assets_dependencies[ASSET_TYPE::NORMAL][asset_to_matrix.first];
+        // Pack the visible instances into this frame's section of the instance stream, also in jobs
+        GLintptr instance_stream_offset = 0;
+        if (!instance_commands.empty()) {
+            auto size = (GLsizeiptr) (instance_commands.size() * sizeof(render_instance));
+            stream_reserve(gl_names.instance_stream, size);
+            auto *visible_instances = (render_instance *) stream_map(gl_names.instance_stream, size, instance_stream_offset);
 
-            GLint model_matrix_uniform_location = gl_names.shader_programs_to_model_matrix_uniform_locations[shader_program];
-            GLint view_matrix_uniform_location = gl_names.shader_programs_to_view_matrix_uniform_locations[shader_program];
-            GLint projection_matrix_uniform_location = gl_names.shader_programs_to_projection_matrix_uniform_locations[shader_program];
-            GLint diffuse_texture_uniform_location = gl_names.shader_programs_to_diffuse_texture_uniform_locations[shader_program];
-            GLint normal_texture_uniform_location = gl_names.shader_programs_to_normal_texture_uniform_locations[shader_program];
+            worker_pool().parallel_for(instance_commands.size(), render_job_grain, [visible_instances](std::size_t begin, std::size_t end) {
+                for (std::size_t i = begin; i < end; i++) {
+                    const instance_command &command = instance_commands[i];
+                    visible_instances[i] = render_batches[command.batch].instances[command.instance];
+                }
+            });
 
-            glUseProgram(shader_program);
+            stream_unmap(gl_names.instance_stream);
+        }
 
-            glUniform1i(diffuse_texture_uniform_location, 0);
-            glUniform1i(normal_texture_uniform_location, 1);
-            glUniformMatrix4fv(projection_matrix_uniform_location, 1, GL_FALSE, &projection_matrix[0][0]);
-            glUniformMatrix4fv(view_matrix_uniform_location, 1, GL_FALSE, &view_matrix[0][0]);
+        radix_sort(render_commands, render_commands_scratch, [](const render_command &command) { return command.key; });
 
+        state_bind_array_buffer(gl_names.instance_stream.buffer);
+        for (const render_command &command: render_commands) {
+            const render_batch &batch = render_batches[command.batch];
 
-            glBindVertexArray(model);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, diffuse_texture);
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_2D, normal_texture);
-            glActiveTexture(GL_TEXTURE0);
+            std::size_t first_offset = instance_stream_offset + batch.first_visible_instance * sizeof(render_instance);
 
-            for (const auto &matrix: asset_to_matrix.second) {
-                glUniformMatrix4fv(model_matrix_uniform_location, 1, GL_FALSE, &matrix[0][0]);
+            state_use_program(batch.material.shader_program);
+            state_bind_vertex_array(batch.material.vertex_array);
+            state_bind_texture(diffuse_texture_unit, batch.material.texture_target, batch.material.diffuse_texture);
+            state_bind_texture(normal_texture_unit, batch.material.texture_target, batch.material.normal_texture);
 
-                glDrawElements(GL_TRIANGLES, element_count, GL_UNSIGNED_INT, nullptr);
+            // A mat4 attribute takes up four consecutive locations, one per column
+            for (GLuint column = 0; column < 4; column++) {
+                GLuint location = instance_model_matrix_attribute_location + column;
+                std::size_t offset = first_offset + offsetof(render_instance, model) + column * sizeof(glm::vec4);
+                glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(render_instance), (void *) offset);
+                glEnableVertexAttribArray(location);
+                glVertexAttribDivisor(location, 1);
             }
+
+            glVertexAttribPointer(instance_uv_diffuse_attribute_location, 4, GL_FLOAT, GL_FALSE, sizeof(render_instance),
+                                  (void *) (first_offset + offsetof(render_instance, uv_diffuse)));
+            glEnableVertexAttribArray(instance_uv_diffuse_attribute_location);
+            glVertexAttribDivisor(instance_uv_diffuse_attribute_location, 1);
+            glVertexAttribPointer(instance_uv_normal_attribute_location, 4, GL_FLOAT, GL_FALSE, sizeof(render_instance),
+                                  (void *) (first_offset + offsetof(render_instance, uv_normal)));
+            glEnableVertexAttribArray(instance_uv_normal_attribute_location);
+            glVertexAttribDivisor(instance_uv_normal_attribute_location, 1);
+            glVertexAttribPointer(instance_layers_attribute_location, 2, GL_FLOAT, GL_FALSE, sizeof(render_instance),
+                                  (void *) (first_offset + offsetof(render_instance, layers)));
+            glEnableVertexAttribArray(instance_layers_attribute_location);
+            glVertexAttribDivisor(instance_layers_attribute_location, 1);
+
+            auto instance_count = (GLsizei) batch.visible_count;
+            const model_range &model = batch.material.model;
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, model.element_count, GL_UNSIGNED_INT,
+                                              (void *) (model.first_element * sizeof(std::uint32_t)),
+                                              instance_count, model.base_vertex);
+            render_stats.draw_calls++;
         }
+
+        stream_end_frame(gl_names.instance_stream);
+
+        for (const sprite_request &request: snapshot.sprites)
+            queue_sprite(request);
+        flush_sprites();
     }
 }
@@ -19,13 +19,112 @@
 
 #include <glm/ext/matrix_transform.hpp>
 
+#include <algorithm>
+#include <stdexcept>
+
 namespace flatshaper::systems {
-    std::unordered_map<entityid_t, glm::vec3> physics_position;
-    std::unordered_map<entityid_t, glm::mat4> physics_matrix;
+    component_store<glm::vec3> physics_position;
+    component_store<glm::mat4> physics_matrix;
+
+    // Last change tick whose position writes have been turned into matrices
+    std::uint32_t physics_simulated_tick = 0;
+
+    struct transform_node {
+        entityid_t entityid;
+        entityid_t parent;
+        std::uint32_t depth;
+    };
+
+    component_store<entityid_t> physics_parents;
+    // All entities with a parent, sorted by depth, so a parent's world matrix
+    // is always computed before any of its children's in a single front-to-back pass
+    std::vector<transform_node> transform_hierarchy;
+    bool transform_hierarchy_dirty = false;
+
+    void physics_set_parent(entityid_t entityid, entityid_t parent) {
+        if (parent == null_entity) {
+            physics_clear_parent(entityid);
+            return;
+        }
+
+        for (entityid_t ancestor = parent; ancestor != null_entity; ancestor = physics_get_parent(ancestor)) {
+            if (ancestor == entityid)
+                throw std::runtime_error(u8"Transform hierarchy would contain a cycle");
+        }
+
+        physics_parents.insert(entityid, parent);
+        transform_hierarchy_dirty = true;
+    }
+
+    void physics_clear_parent(entityid_t entityid) {
+        if (physics_parents.erase(entityid)) {
+            transform_hierarchy_dirty = true;
+            // Its matrix is relative to the old parent, so have it rebuilt as a root
+            physics_position.mark_changed(entityid);
+        }
+    }
+
+    entityid_t physics_get_parent(entityid_t entityid) {
+        const entityid_t *parent = physics_parents.find(entityid);
+        return parent == nullptr ? null_entity : *parent;
+    }
+
+    void rebuild_transform_hierarchy() {
+        transform_hierarchy.clear();
+        transform_hierarchy.reserve(physics_parents.size());
+
+        for (std::size_t i = 0; i < physics_parents.size(); i++) {
+            entityid_t entityid = physics_parents.entity_at(i);
+            entityid_t parent = physics_parents.component_at(i);
+
+            std::uint32_t depth = 1;
+            for (entityid_t ancestor = physics_get_parent(parent); ancestor != null_entity; ancestor = physics_get_parent(ancestor)) {
+                depth++;
+            }
+
+            transform_hierarchy.push_back(transform_node{entityid, parent, depth});
+        }
+
+        std::stable_sort(transform_hierarchy.begin(), transform_hierarchy.end(),
+                         [](const transform_node &a, const transform_node &b) { return a.depth < b.depth; });
+    }
 
     void physics_simulate() {
-        for (const auto &item: physics_position) {
-            physics_matrix[item.first] = glm::translate(glm::identity<glm::mat4>(), item.second);
+        std::uint32_t since = physics_simulated_tick;
+        std::uint32_t closed = advance_change_tick();
+        physics_simulated_tick = closed;
+
+        physics_position.each_changed_since(since, [](entityid_t entityid, const glm::vec3 &position) {
+            if (!physics_parents.contains(entityid))
+                physics_matrix.insert(entityid, glm::translate(glm::identity<glm::mat4>(), position));
+        });
+
+        bool rebuild_all = transform_hierarchy_dirty;
+        if (transform_hierarchy_dirty) {
+            rebuild_transform_hierarchy();
+            transform_hierarchy_dirty = false;
+        }
+
+        // Matrices written in this pass are stamped after the closed tick, so a child is only
+        // recomputed if its own position changed or a parent above it was recomputed just now
+        for (const transform_node &node: transform_hierarchy) {
+            std::uint32_t position_index = physics_position.index_of(node.entityid);
+            if (position_index == component_npos)
+                continue;
+
+            std::uint32_t parent_index = physics_matrix.index_of(node.parent);
+            bool parent_changed = parent_index != component_npos &&
+                                  tick_is_newer(physics_matrix.change_tick_at(parent_index), closed);
+            bool position_changed = tick_is_newer(physics_position.change_tick_at(position_index), since);
+
+            if (!rebuild_all && !parent_changed && !position_changed)
+                continue;
+
+            glm::mat4 local = glm::translate(glm::identity<glm::mat4>(), physics_position.component_at(position_index));
+            if (parent_index == component_npos)
+                physics_matrix.insert(node.entityid, local);
+            else
+                physics_matrix.insert(node.entityid, physics_matrix.component_at(parent_index) * local);
         }
     }
 }
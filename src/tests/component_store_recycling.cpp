@@ -0,0 +1,75 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// An entity deleted while a store still holds it leaves a stale handle behind, and its slot is
+// recycled by the next generate_entity_id(). The render queue relies on entity_with_index() to find
+// such a handle and unfile it before it inserts the new entity (see apply_add_entity), since
+// insert() would evict it silently.
+
+#include <flatshaper/entity.hpp>
+#include <flatshaper/component_store.hpp>
+
+#include <iostream>
+
+
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const char *description) {
+        if (!condition) {
+            std::cerr << "FAILED: " << description << std::endl;
+            failures++;
+        }
+    }
+}
+
+int main() {
+    using namespace flatshaper;
+
+    component_store<int> store;
+    check(store.entity_with_index(0) == null_entity, u8"empty store has no entity at any index");
+
+    entityid_t stale = generate_entity_id();
+    store.insert(stale, 1);
+    delete_entity(stale);
+
+    entityid_t recycled = generate_entity_id();
+    check(entity_index(recycled) == entity_index(stale) && recycled != stale, u8"slot is recycled with a new generation");
+    check(!store.contains(recycled), u8"recycled handle is not in the store yet");
+    check(store.contains(stale), u8"stale handle is still in the store");
+    check(store.entity_with_index(entity_index(recycled)) == stale, u8"entity_with_index finds the stale handle");
+
+    // What apply_add_entity does: remove whatever holds the index, then insert
+    entityid_t previous = store.entity_with_index(entity_index(recycled));
+    check(store.erase(previous), u8"stale handle can be erased");
+    store.insert(recycled, 2);
+    check(store.size() == 1 && store.contains(recycled) && !store.contains(stale), u8"only the new entity remains");
+    check(store.entity_with_index(entity_index(recycled)) == recycled, u8"entity_with_index finds the new entity");
+
+    // Without the removal, insert() evicts the stale handle on its own
+    delete_entity(recycled);
+    entityid_t evicting = generate_entity_id();
+    store.insert(evicting, 3);
+    check(store.size() == 1 && store.contains(evicting) && !store.contains(recycled), u8"insert evicts a stale handle");
+    check(store.entity_with_index(entity_index(evicting) + 1) == null_entity, u8"unused index has no entity");
+
+    if (failures > 0)
+        return 1;
+
+    std::cout << "OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,100 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+#include <flatshaper/thread_pool.hpp>
+
+#include <algorithm>
+
+
+namespace flatshaper {
+    thread_pool::thread_pool(std::size_t worker_count) {
+        workers.reserve(worker_count);
+        for (std::size_t i = 0; i < worker_count; i++)
+            workers.emplace_back(&thread_pool::worker_loop, this);
+    }
+
+    thread_pool::~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+
+        wake.notify_all();
+        for (std::thread &worker: workers)
+            worker.join();
+    }
+
+    void thread_pool::run_jobs() {
+        std::size_t index;
+        while ((index = next_job.fetch_add(1, std::memory_order_relaxed)) < job_count)
+            (*job)(index);
+    }
+
+    void thread_pool::run(std::size_t count, const std::function<void(std::size_t)> &function) {
+        if (count == 0)
+            return;
+
+        // Not worth waking anyone for
+        if (count == 1 || workers.empty()) {
+            for (std::size_t index = 0; index < count; index++)
+                function(index);
+            return;
+        }
+
+        std::lock_guard<std::mutex> run_lock(run_mutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &function;
+            job_count = count;
+            next_job.store(0, std::memory_order_relaxed);
+            busy_workers = workers.size();
+            generation++;
+        }
+
+        wake.notify_all();
+        run_jobs();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy_workers == 0; });
+        job = nullptr;
+    }
+
+    void thread_pool::worker_loop() {
+        std::uint64_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen_generation] { return stopping || generation != seen_generation; });
+                if (stopping)
+                    return;
+
+                seen_generation = generation;
+            }
+
+            run_jobs();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy_workers == 0)
+                done.notify_one();
+        }
+    }
+
+    thread_pool &worker_pool() {
+        static thread_pool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+}
@@ -0,0 +1,195 @@
+// flatshaper, a small video game
+// Copyright (C) 2023  computingcrow
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along
+// with this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+// Offline atlas builder: packs every DIFFUSE and NORMAL texture of an assets database into
+// shared pages and writes a new database in which those assets point at a page plus the UV
+// rectangle of their image. Usage: flatshaper_atlas <input assets.csv> <output assets.csv> [page size]
+
+#include <flatshaper/atlas.hpp>
+
+#include <IL/il.h>
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+    constexpr std::uint32_t default_page_size = 2048;
+    constexpr std::uint32_t atlas_padding = 2;
+
+    struct texture_entry {
+        std::string assetid;
+        std::string asset_type;
+        std::filesystem::path file;
+        std::vector<std::uint8_t> pixels;
+    };
+
+    std::vector<std::uint8_t> load_rgba(const std::filesystem::path &file, std::uint32_t &width, std::uint32_t &height) {
+        ILuint image_name = ilGenImage();
+        ilBindImage(image_name);
+        if (!ilLoadImage(std::filesystem::absolute(file).c_str()) || !ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE))
+            throw std::runtime_error(u8"Cannot load texture " + file.string());
+
+        width = (std::uint32_t) ilGetInteger(IL_IMAGE_WIDTH);
+        height = (std::uint32_t) ilGetInteger(IL_IMAGE_HEIGHT);
+        std::vector<std::uint8_t> pixels(ilGetData(), ilGetData() + ((std::size_t) width) * height * 4);
+
+        ilBindImage(0);
+        ilDeleteImage(image_name);
+        return pixels;
+    }
+
+    // Copies the image into the page, with its border pixels repeated into the padding
+    void blit(std::vector<std::uint8_t> &page, std::uint32_t page_size, const texture_entry &texture,
+              const flatshaper::atlas_rect &rect) {
+        for (std::uint32_t y = 0; y < rect.height + 2 * atlas_padding; y++) {
+            std::uint32_t source_y = std::min(rect.height - 1, y < atlas_padding ? 0 : y - atlas_padding);
+            for (std::uint32_t x = 0; x < rect.width + 2 * atlas_padding; x++) {
+                std::uint32_t source_x = std::min(rect.width - 1, x < atlas_padding ? 0 : x - atlas_padding);
+                std::size_t target = (((std::size_t) rect.y - atlas_padding + y) * page_size + rect.x - atlas_padding + x) * 4;
+                std::memcpy(page.data() + target, texture.pixels.data() + (((std::size_t) source_y) * rect.width + source_x) * 4, 4);
+            }
+        }
+    }
+
+    void save_page(const std::vector<std::uint8_t> &page, std::uint32_t page_size, const std::filesystem::path &file) {
+        ILuint image_name = ilGenImage();
+        ilBindImage(image_name);
+        ilTexImage(page_size, page_size, 1, 4, IL_RGBA, IL_UNSIGNED_BYTE, (void *) page.data());
+        ilRegisterOrigin(IL_ORIGIN_UPPER_LEFT);
+        if (!ilSaveImage(std::filesystem::absolute(file).c_str()))
+            throw std::runtime_error(u8"Cannot save atlas page " + file.string());
+
+        ilBindImage(0);
+        ilDeleteImage(image_name);
+    }
+
+    std::string to_string(float value) {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        return std::string(buffer, result.ptr);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << u8"Usage: flatshaper_atlas <input assets.csv> <output assets.csv> [page size]" << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path input_file = std::filesystem::absolute(std::filesystem::u8path(argv[1]));
+    std::filesystem::path output_file = std::filesystem::absolute(std::filesystem::u8path(argv[2]));
+    std::filesystem::path input_directory = input_file.parent_path();
+    std::filesystem::path output_directory = output_file.parent_path();
+
+    std::uint32_t page_size = default_page_size;
+    if (argc > 3 && std::from_chars(argv[3], argv[3] + std::strlen(argv[3]), page_size).ec != std::errc())
+        throw std::runtime_error(u8"Invalid page size");
+
+    ilInit();
+    ilEnable(IL_FILE_OVERWRITE);
+    // Rows are kept in file order (top row first), the order in which the game uploads textures,
+    // so that v in the emitted rectangles addresses the same rows at runtime
+    ilEnable(IL_ORIGIN_SET);
+    ilOriginFunc(IL_ORIGIN_UPPER_LEFT);
+
+    // Textures that already carry a UV rectangle are atlased already and are passed through
+    std::vector<std::string> passed_lines;
+    std::vector<texture_entry> textures;
+
+    std::ifstream input_stream(input_file);
+    std::string line;
+    while (std::getline(input_stream, line)) {
+        if (line.empty())
+            continue;
+
+        auto type_idx = line.find(u8';');
+        auto file_idx = line.find(u8';', type_idx + 1);
+        if (type_idx == std::string::npos || file_idx == std::string::npos)
+            throw std::runtime_error(u8"Invalid assets database line");
+
+        std::string assetid = line.substr(0, type_idx);
+        std::string asset_type = line.substr(type_idx + 1, file_idx - type_idx - 1);
+        std::string file = line.substr(file_idx + 1);
+        bool is_texture = asset_type == u8"DIFFUSE" || asset_type == u8"NORMAL";
+
+        if (is_texture && file.find(u8';') == std::string::npos) {
+            textures.push_back(texture_entry{assetid, asset_type, input_directory / file, {}});
+        } else {
+            // Keep the relative paths valid from the output's directory
+            std::string rest = file.substr(std::min(file.size(), file.find(u8';')));
+            std::filesystem::path relative = std::filesystem::relative(input_directory / file.substr(0, file.find(u8';')), output_directory);
+            passed_lines.push_back(assetid + u8";" + asset_type + u8";" + relative.generic_string() + rest);
+        }
+    }
+    input_stream.close();
+
+    std::ofstream output_stream(output_file);
+    for (const std::string &passed_line: passed_lines)
+        output_stream << passed_line << u8"\n";
+
+    std::filesystem::create_directories(output_directory / u8"atlas");
+
+    // Diffuse and normal maps are bound to different samplers, so they get separate pages
+    for (const char *asset_type: {u8"DIFFUSE", u8"NORMAL"}) {
+        std::vector<texture_entry *> entries;
+        std::vector<flatshaper::atlas_rect> rects;
+        for (texture_entry &texture: textures) {
+            if (texture.asset_type != asset_type)
+                continue;
+
+            flatshaper::atlas_rect rect{};
+            texture.pixels = load_rgba(texture.file, rect.width, rect.height);
+            entries.push_back(&texture);
+            rects.push_back(rect);
+        }
+
+        std::uint32_t page_count = flatshaper::atlas_pack(rects, page_size, page_size, atlas_padding);
+        std::string page_prefix = asset_type == std::string(u8"DIFFUSE") ? u8"atlas/diffuse_" : u8"atlas/normal_";
+
+        for (std::uint32_t page_index = 0; page_index < page_count; page_index++) {
+            std::vector<std::uint8_t> page(((std::size_t) page_size) * page_size * 4, 0);
+            std::string page_file = page_prefix + std::to_string(page_index) + u8".png";
+
+            for (std::size_t i = 0; i < rects.size(); i++) {
+                const flatshaper::atlas_rect &rect = rects[i];
+                if (rect.page != page_index)
+                    continue;
+
+                blit(page, page_size, *entries[i], rect);
+                output_stream << entries[i]->assetid << u8";" << asset_type << u8";" << page_file
+                              << u8";" << to_string((float) rect.x / (float) page_size)
+                              << u8";" << to_string((float) rect.y / (float) page_size)
+                              << u8";" << to_string((float) rect.width / (float) page_size)
+                              << u8";" << to_string((float) rect.height / (float) page_size) << u8"\n";
+            }
+
+            save_page(page, page_size, output_directory / page_file);
+        }
+
+        std::cout << asset_type << u8": " << rects.size() << u8" textures on " << page_count << u8" pages" << std::endl;
+    }
+
+    output_stream.close();
+    return 0;
+}